@@ -10,6 +10,7 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -44,6 +45,8 @@ double** MatrixMultiply(double** const A, double** const B, int N, int T)
   #pragma omp parallel for num_threads(T)
   for (int i = 0; i < N; i++)
   {
+    TRACE_SCOPE("row");
+
     for (int j = 0; j < N; j++)
     {
       for (int k = 0; k < N; k++)
@@ -0,0 +1,266 @@
+/* trace.h */
+
+//
+// Low-overhead timeline tracing. Each thread records begin/end events into
+// its own ring buffer (no locks, nothing shared on the hot path). At the end
+// of the run the buffers of every thread --- and in MPI apps, of every rank ---
+// are merged into a single Chrome trace file, which can be opened with
+// chrome://tracing or https://ui.perfetto.dev.
+//
+// Tracing is compiled in only when building with -DTRACE ("make trace").
+// Otherwise every macro below expands to nothing, so instrumented hot loops
+// cost nothing.
+//
+// Usage:
+//   TRACE_SCOPE("do_work");             // event spans the enclosing { }
+//   TRACE_BEGIN("phase"); ... TRACE_END("phase");
+//   TRACE_INIT();                       // once, at start of main
+//   TRACE_WRITE("trace.json");          // once, at end of main
+//
+// NOTE: event names must be string literals (only the pointer is stored).
+// NOTE: in MPI apps include <mpi.h> *before* this file; TRACE_INIT and
+// TRACE_WRITE are then collective calls, and must be called by every rank
+// (TRACE_INIT right after MPI_Init, TRACE_WRITE before MPI_Finalize).
+//
+
+#pragma once
+
+#ifdef TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace trace {
+
+//
+// one begin ('B') or end ('E') event:
+//
+struct Event {
+  const char* name;
+  int64_t     ts;    // nanoseconds
+  char        ph;
+};
+
+//
+// per-thread ring buffer; once full, the oldest events are overwritten:
+//
+const uint64_t CAPACITY = 1 << 16;  // must be a power of 2
+
+struct Buffer {
+  Event                 events[CAPACITY];
+  std::atomic<uint64_t> head{0};
+  int                   tid = 0;
+  Buffer*               next = nullptr;
+};
+
+inline std::atomic<Buffer*>& buffers()
+{
+  static std::atomic<Buffer*> list{nullptr};
+  return list;
+}
+
+inline int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// local: returns the calling thread's buffer, creating and registering it
+// (lock-free push onto the global list) on first use.
+//
+inline Buffer* local()
+{
+  static std::atomic<int> nextTid{0};
+  thread_local Buffer* buf = nullptr;
+
+  if (buf == nullptr) {
+    buf = new Buffer();
+    buf->tid = nextTid++;
+    buf->next = buffers().load();
+    while (!buffers().compare_exchange_weak(buf->next, buf))
+      ;
+  }
+
+  return buf;
+}
+
+//
+// start: this process's t0, set by init (0 if init was never called).
+//
+inline int64_t& start()
+{
+  static int64_t t0 = 0;
+  return t0;
+}
+
+//
+// init: records the start of the timeline. In MPI apps every rank first
+// waits at a barrier, then takes the time it leaves as its own t0, so all
+// timelines start at 0 and line up to within the barrier's precision ---
+// without comparing the clocks of different nodes, which don't share an
+// epoch.
+//
+inline void init()
+{
+#if defined(MPI_VERSION)
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  start() = now();
+}
+
+//
+// earliest: the time of the earliest event still in this process's buffers
+// (now, if there are none).
+//
+inline int64_t earliest()
+{
+  int64_t t0 = now();
+  for (Buffer* buf = buffers().load(); buf != nullptr; buf = buf->next) {
+    uint64_t head = buf->head.load(std::memory_order_acquire);
+    uint64_t first = (head > CAPACITY) ? head - CAPACITY : 0;
+    if (head > first && buf->events[first & (CAPACITY - 1)].ts < t0)
+      t0 = buf->events[first & (CAPACITY - 1)].ts;
+  }
+  return t0;
+}
+
+inline void record(const char* name, char ph)
+{
+  Buffer* buf = local();
+  uint64_t h = buf->head.load(std::memory_order_relaxed);
+
+  buf->events[h & (CAPACITY - 1)] = Event{ name, now(), ph };
+  buf->head.store(h + 1, std::memory_order_release);
+}
+
+struct Scope {
+  const char* name;
+
+  Scope(const char* n) : name(n) { record(name, 'B'); }
+  ~Scope() { record(name, 'E'); }
+};
+
+//
+// to_json: appends the events of every thread in this process, with
+// timestamps relative to t0, as Chrome trace event objects.
+//
+inline void to_json(std::string& out, int pid, int64_t t0)
+{
+  char line[256];
+
+  snprintf(line, sizeof(line),
+    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}},\n",
+    pid, pid);
+  out += line;
+
+  for (Buffer* buf = buffers().load(); buf != nullptr; buf = buf->next)
+  {
+    uint64_t head = buf->head.load(std::memory_order_acquire);
+    uint64_t first = (head > CAPACITY) ? head - CAPACITY : 0;
+    int depth = 0;
+
+    for (uint64_t i = first; i < head; i++)
+    {
+      const Event& e = buf->events[i & (CAPACITY - 1)];
+
+      // if the ring wrapped, drop end events whose begin was overwritten:
+      if (e.ph == 'E' && depth == 0)
+        continue;
+      depth += (e.ph == 'B') ? 1 : -1;
+
+      snprintf(line, sizeof(line),
+        "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+        e.name, e.ph, (e.ts - t0) / 1000.0, pid, buf->tid);
+      out += line;
+    }
+  }
+}
+
+inline void write_file(const char* filename, std::string& events)
+{
+  // drop trailing ",\n" so the array is valid JSON:
+  if (events.size() >= 2)
+    events.resize(events.size() - 2);
+
+  FILE* f = fopen(filename, "w");
+  if (f == nullptr) {
+    fprintf(stderr, "** trace: unable to open '%s'\n", filename);
+    return;
+  }
+
+  fprintf(f, "{\"traceEvents\":[\n%s\n]}\n", events.c_str());
+  fclose(f);
+}
+
+//
+// write: merges all thread buffers into a Chrome trace, with timestamps
+// relative to init's t0 (or, if init wasn't called, to the earliest event).
+// In MPI apps every rank serializes its events relative to its own t0, and
+// rank 0 gathers them and writes the file.
+//
+inline void write(const char* filename)
+{
+  std::string events;
+
+#if defined(MPI_VERSION)
+  int myRank, numProcs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+
+  to_json(events, myRank, (start() != 0) ? start() : earliest());
+
+  int length = (int) events.size();
+  int* lengths = (myRank == 0) ? new int[numProcs] : nullptr;
+  int* displs = (myRank == 0) ? new int[numProcs] : nullptr;
+
+  MPI_Gather(&length, 1, MPI_INT, lengths, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  std::string all;
+  if (myRank == 0) {
+    int total = 0;
+    for (int r = 0; r < numProcs; r++) {
+      displs[r] = total;
+      total += lengths[r];
+    }
+    all.resize(total);
+  }
+
+  MPI_Gatherv(events.data(), length, MPI_CHAR,
+              (myRank == 0) ? &all[0] : nullptr, lengths, displs, MPI_CHAR,
+              0, MPI_COMM_WORLD);
+
+  if (myRank == 0) {
+    write_file(filename, all);
+    delete[] lengths;
+    delete[] displs;
+  }
+#else
+  to_json(events, 0, (start() != 0) ? start() : earliest());
+  write_file(filename, events);
+#endif
+}
+
+}//namespace
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT2(a, b)
+
+#define TRACE_SCOPE(name)   trace::Scope TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#define TRACE_BEGIN(name)   trace::record(name, 'B')
+#define TRACE_END(name)     trace::record(name, 'E')
+#define TRACE_INIT()        trace::init()
+#define TRACE_WRITE(file)   trace::write(file)
+
+#else
+
+#define TRACE_SCOPE(name)   ((void)0)
+#define TRACE_BEGIN(name)   ((void)0)
+#define TRACE_END(name)     ((void)0)
+#define TRACE_INIT()        ((void)0)
+#define TRACE_WRITE(file)   ((void)0)
+
+#endif
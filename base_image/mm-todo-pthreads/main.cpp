@@ -23,6 +23,7 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -85,6 +86,8 @@ int main(int argc, char *argv[])
 	cout << "** Execution complete **" << endl;
     cout << endl;
 
+    TRACE_WRITE("trace.json");
+
 	Delete2dMatrix(A);
 	Delete2dMatrix(B);
 	Delete2dMatrix(C);
@@ -10,6 +10,7 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "trace.h"
 #include "pthread.h"
 
 using namespace std;
@@ -149,6 +150,8 @@ static void* mm(void* msg)
   //
   for (int i = startRow; i < endRow; i++)
   {
+    TRACE_SCOPE("row");
+
     for (int k = 0; k < N; k++)
     {
       for (int j = 0; j < N; j++)
@@ -3,6 +3,7 @@
 #include <mpi.h>
 #include <omp.h>
 #include <cstring>
+#include "trace.h"
 
 extern int myRank, numProcs, numThreads;
 void fw_helper(int** chunkMatrix, int numVertices, int actualChunkSize);
@@ -35,18 +36,22 @@ void floydWarshall(int** distMatrix, int numVertices) {
 
     int* sendBuffer = (myRank == 0) ? distMatrix[0] : nullptr;
 
+    TRACE_BEGIN("scatter");
     MPI_Scatterv(sendBuffer, sendcounts, displs, MPI_INT,
                  chunkMatrix[0], recvCount, MPI_INT,
                  sender, MPI_COMM_WORLD);
+    TRACE_END("scatter");
     
     int actualChunkSize = (myRank == 0) ? chunkSize + extraRows : chunkSize;
     fw_helper(chunkMatrix, numVertices, actualChunkSize);
     
     int* recvBuffer = (myRank == 0) ? distMatrix[0] : nullptr;
 
+    TRACE_BEGIN("gather");
     MPI_Gatherv(chunkMatrix[0], recvCount, MPI_INT,
                 recvBuffer, recvcounts, displs, MPI_INT,
                 receiver, MPI_COMM_WORLD);
+    TRACE_END("gather");
 
     delete[] sendcounts;
     delete[] recvcounts;
@@ -81,17 +86,25 @@ void fw_helper(int** chunkMatrix, int numVertices, int actualChunkSize) {
             memcpy(row_k, chunkMatrix[offset], numVertices * sizeof(int));
         }
 
+        TRACE_BEGIN("bcast row k");
         MPI_Bcast(row_k, numVertices, MPI_INT, sender, MPI_COMM_WORLD);
+        TRACE_END("bcast row k");
         
-        #pragma omp parallel for schedule(static) num_threads(numThreads)
-        for (int i = 0; i < actualChunkSize; i++) {
-            for (int j = 0; j < numVertices; j++) {
-                // Skip if no path through k
-                if (chunkMatrix[i][k] == -1 || row_k[j] == -1) continue;
-                
-                // Check if path through k is shorter
-                if (chunkMatrix[i][k] + row_k[j] < chunkMatrix[i][j]) {
-                    chunkMatrix[i][j] = chunkMatrix[i][k] + row_k[j];
+        #pragma omp parallel num_threads(numThreads)
+        {
+            // one event per thread per k, so barrier waits show up as gaps
+            TRACE_SCOPE("relax");
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < actualChunkSize; i++) {
+                for (int j = 0; j < numVertices; j++) {
+                    // Skip if no path through k
+                    if (chunkMatrix[i][k] == -1 || row_k[j] == -1) continue;
+                    
+                    // Check if path through k is shorter
+                    if (chunkMatrix[i][k] + row_k[j] < chunkMatrix[i][j]) {
+                        chunkMatrix[i][j] = chunkMatrix[i][k] + row_k[j];
+                    }
                 }
             }
         }
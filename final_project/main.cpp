@@ -27,6 +27,7 @@ int main(int argc, char* argv[]) {
     MPI_Init(&argc, &argv);
 	MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+	TRACE_INIT();  // line up the ranks' trace timelines
 
     if (argc != 5) {
         std::cout << std::endl;
@@ -114,6 +115,8 @@ int main(int argc, char* argv[]) {
         Delete2dMatrix(distMatrix);
     }
 
+    TRACE_WRITE("trace.json");
+
     MPI_Finalize();
     return 0;
 
@@ -0,0 +1,127 @@
+#!/bin/bash
+
+# Scaling benchmark for the WorkMatrix / WorkGraph schedulers. Runs every
+# scheduling strategy across a sweep of thread counts, repeating each run,
+# and reports speedup, efficiency, makespan vs. the ideal lower bound and
+# load imbalance. Raw per-run results are written to a CSV file for plotting.
+#
+# Usage: ./bench.sh [-a matrix|graph] [-s "Strategies"] [-t "ThreadCounts"]
+#                   [-r Repeats] [-o results.csv]
+#
+# By default the synthetic workloads are benchmarked (built via "make synth");
+# set BIN to benchmark some other build, and WM_* / WG_* to choose the
+# workload (see workmatrix-synth.cpp and workgraph-synth.cpp).
+#
+# Metrics, per run:
+#   speedup      = mean 1-thread time (same strategy) / time
+#   efficiency   = speedup / threads
+#   lower_bound  = max(busy_sum / threads, most expensive cell or vertex)
+#   vs_bound     = time / lower_bound     (1.0 is a perfect schedule)
+#   imbalance    = (busiest thread / average thread - 1) * 100%
+#
+
+APP=matrix
+STRATEGIES=""
+THREADS=""
+REPEATS=3
+CSV=""
+
+while getopts "a:s:t:r:o:" opt; do
+  case $opt in
+    a) APP=$OPTARG ;;
+    s) STRATEGIES=$OPTARG ;;
+    t) THREADS=$OPTARG ;;
+    r) REPEATS=$OPTARG ;;
+    o) CSV=$OPTARG ;;
+    *) echo "Usage: $0 [-a matrix|graph] [-s \"Strategies\"] [-t \"ThreadCounts\"] [-r Repeats] [-o results.csv]"
+       exit 1 ;;
+  esac
+done
+
+cd "$(dirname "$0")"
+
+if [ "$APP" == "matrix" ]; then
+  DIR=.
+  STRATEGIES=${STRATEGIES:-"static dynamic guided tasks numa"}
+elif [ "$APP" == "graph" ]; then
+  DIR=project01-part02
+  STRATEGIES=${STRATEGIES:-"tasks numa frontier actor priority"}
+else
+  echo "**Unknown app '$APP' (matrix or graph)"
+  exit 1
+fi
+
+CSV=${CSV:-bench_$APP.csv}
+
+if [ -z "$BIN" ]; then
+  make -s -C $DIR synth || exit 1
+  BIN=$DIR/work-synth
+fi
+
+# default sweep: 1, 2, 4, ... up to the # of cores:
+if [ -z "$THREADS" ]; then
+  for ((t = 1; t < $(nproc); t *= 2)); do THREADS="$THREADS $t"; done
+  THREADS="$THREADS $(nproc)"
+fi
+
+# speedup needs a 1-thread baseline, which must run first:
+THREADS="1 $(echo $THREADS | tr ' ' '\n' | grep -vx 1 | sort -n | uniq | tr '\n' ' ')"
+
+RAW=$(mktemp)
+trap "rm -f $RAW" EXIT
+
+echo "=========================================="
+echo "Benchmarking $BIN ($APP), $REPEATS repeats"
+echo "Results: $CSV"
+echo
+
+for s in $STRATEGIES; do
+  for t in $THREADS; do
+    for ((r = 1; r <= REPEATS; r++)); do
+      stats=$($BIN -t $t -s $s | grep "^\*\* Stats:")
+      if [ -z "$stats" ]; then
+        echo "**Run failed: $BIN -t $t -s $s"
+        exit 1
+      fi
+
+      # app,strategy,threads,repeat,time,lower_bound,vs_bound,imbalance_pct:
+      echo "$stats" | awk -v app=$APP -v s=$s -v t=$t -v r=$r '{
+        for (i = 3; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+        avg = v["busy_sum"] / t
+        bound = (v["task_max"] > avg) ? v["task_max"] : avg
+        printf "%s,%s,%d,%d,%.6f,%.6f,%.3f,%.1f\n", app, s, t, r, v["wall"], bound,
+               (bound > 0) ? v["wall"] / bound : 0, (avg > 0) ? (v["busy_max"] / avg - 1) * 100 : 0
+      }' >> $RAW
+    done
+  done
+done
+
+#
+# add speedup and efficiency relative to each strategy's mean 1-thread time:
+#
+echo "app,strategy,threads,repeat,time,speedup,efficiency,lower_bound,vs_bound,imbalance_pct" > $CSV
+
+awk -F, 'NR == FNR { if ($3 == 1) { base[$2] += $5; n[$2]++ } next }
+  {
+    speedup = (base[$2] / n[$2]) / $5
+    printf "%s,%s,%d,%d,%s,%.3f,%.3f,%s,%s,%s\n", $1, $2, $3, $4, $5, speedup, speedup / $3, $6, $7, $8
+  }' $RAW $RAW >> $CSV
+
+#
+# summary: mean over repeats for each strategy and thread count:
+#
+awk -F, 'NR > 1 {
+    key = $2 "," $3
+    if (!(key in n)) order[++keys] = key
+    n[key]++; time[key] += $5; sp[key] += $6; eff[key] += $7; vs[key] += $9; imb[key] += $10
+  }
+  END {
+    printf "%-10s %7s %9s %8s %10s %9s %10s\n", "strategy", "threads", "time", "speedup", "efficiency", "vs_bound", "imbalance"
+    for (i = 1; i <= keys; i++) {
+      k = order[i]; split(k, f, ",")
+      printf "%-10s %7d %9.3f %8.2f %9.0f%% %9.2f %9.1f%%\n", f[1], f[2], time[k] / n[k],
+             sp[k] / n[k], 100 * eff[k] / n[k], vs[k] / n[k], imb[k] / n[k]
+    }
+  }' $CSV
+
+echo "=========================================="
@@ -0,0 +1,84 @@
+/*checkpoint.h*/
+
+//
+// Checkpoint/resume support for long work matrix runs. Completed cells
+// (and the result of do_work for each) are recorded in a pair of bitmaps;
+// a background thread periodically appends the newly completed cells to
+// an append-only checkpoint file. On restart the file is replayed, so
+// cells that were already solved can be skipped.
+//
+// Marking a cell complete is a single atomic OR on a bitmap word, so the
+// cost on the worker threads is negligible compared to do_work.
+//
+// Checkpoint file format (native byte order):
+//   header:  "WMCK", rows, cols            (3 x 4 bytes)
+//   records: (cell << 1) | result           (4 bytes each, appended)
+// A truncated trailing record (e.g. killed mid-write) is ignored. When a
+// checkpoint is opened it is compacted, i.e. rewritten via a temp file and
+// rename, so the file on disk is always valid.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Checkpoint {
+    public:
+
+      //
+      // opens (or creates) the checkpoint file for a rows x cols matrix,
+      // loading any cells completed by a previous run. A file written for
+      // a different matrix size is discarded. Flushes happen every
+      // intervalSecs seconds in a background thread.
+      //
+      Checkpoint(const char* filename, int rows, int cols, int intervalSecs = 5);
+
+      // destructor: stops the flusher and performs a final flush.
+      ~Checkpoint();
+
+      // # of cells completed so far (including those loaded at startup):
+      int num_completed();
+
+      // # of cells loaded from a previous run:
+      int num_resumed();
+
+      // has the given cell (row * cols + col) already been solved?
+      bool is_complete(int cell);
+
+      // result of do_work for a completed cell:
+      bool result(int cell);
+
+      // records that the cell is solved; thread-safe and lock-free.
+      void complete(int cell, bool result);
+
+      // appends all newly completed cells to the file.
+      void flush();
+
+    private:
+      static int words(int cells) { return (cells + 63) / 64; }
+
+      void load(const char* filename);
+      void rewrite(const char* filename);
+      void flusher();
+
+      int   Rows, Cols, Cells;
+      int   IntervalSecs;
+      int   Resumed;
+      FILE* File;
+
+      std::atomic<uint64_t>* Done;      // bit set => cell complete
+      std::atomic<uint64_t>* Results;   // bit set => do_work returned true
+      std::vector<uint64_t>  Flushed;   // cells already written to file
+
+      std::mutex              FlushMutex;
+      std::mutex              WaitMutex;
+      std::condition_variable WaitCV;
+      bool                    Stop;
+      std::thread             Flusher;
+};
@@ -6,7 +6,14 @@
 // but doesn't scale. A much more dynamic solution is needed.
 // 
 // Usage:
-//   work [-?] [-t NumThreads]
+//   work [-?] [-t NumThreads] [-s Strategy] [-c CheckpointFile]
+//
+// Strategy is how cells are scheduled across threads: static, dynamic
+// (the default), guided, tasks (one OpenMP task per cell), or numa
+// (hierarchical work stealing, see numa.h).
+//
+// With -c, completed cells are checkpointed to the given file every few
+// seconds; rerunning with the same file resumes where the last run stopped.
 //
 // Author:
 //   << YOUR NAME >>
@@ -21,10 +28,17 @@
 #include <string>
 #include <cstring>
 #include <chrono>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <sys/sysinfo.h>
 #include <omp.h>
 #include "alloc2D.h"
 #include "workmatrix.h"
+#include "checkpoint.h"
+#include "numa.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -34,11 +48,29 @@ using namespace std;
 //
 static int _numThreads = 1;  // default to sequential execution
 static int cells = 0;
+static char* _checkpointFile = nullptr;  // default to no checkpointing
+static string _strategy = "dynamic";
+
+//
+// Per-thread statistics, padded so threads don't share cache lines:
+//
+struct alignas(64) ThreadStats {
+	double busy = 0.0;     // secs spent in do_work
+	double maxCell = 0.0;  // most expensive cell
+	int    cells = 0;
+};
+
+static vector<ThreadStats> _stats;
+static vector<StealStats>  _steals;  // NUMA scheduler only
+static int                 _numNodes = 0;
 
 //
 // Function prototypes:
 //
 static void ProcessCmdLineArgs(int argc, char* argv[]);
+static void Solve(WorkMatrix& wm, int i, Checkpoint* checkpoint);
+static void RunNuma(WorkMatrix& wm, const vector<int>& todo, Checkpoint* checkpoint);
+static void PrintStats(double wall);
 
 
 //
@@ -58,6 +90,26 @@ int main(int argc, char *argv[])
 
 	cout << "Matrix size:  " << wm.num_rows() << "x" << wm.num_cols() << endl;
 	cout << "# of threads: " << _numThreads << endl;
+	cout << "Strategy:     " << _strategy << endl;
+
+	//
+	// Checkpointing: cells solved by a previous (preempted) run are skipped,
+	// we only schedule the rest:
+	//
+	int numCells = wm.num_rows() * wm.num_cols();
+	Checkpoint* checkpoint = nullptr;
+
+	if (_checkpointFile != nullptr) {
+		checkpoint = new Checkpoint(_checkpointFile, wm.num_rows(), wm.num_cols());
+		cout << "Checkpoint:   " << _checkpointFile
+		     << " (" << checkpoint->num_resumed() << " of " << numCells << " cells already solved)" << endl;
+	}
+
+	vector<int> todo;
+	for (int i = 0; i < numCells; i++)
+		if (checkpoint == nullptr || !checkpoint->is_complete(i))
+			todo.push_back(i);
+
 	cout << endl;
 
 	cout << "working";
@@ -67,29 +119,40 @@ int main(int argc, char *argv[])
 	// Solve each cell in the work matrix. Compute time for speedup
 	// calculations.
 	//
-	int r = 0;
-	int c = 0;
+	_stats.assign(_numThreads, ThreadStats());
+	int numTodo = (int) todo.size();
+
   auto start = chrono::high_resolution_clock::now();
-	#pragma omp parallel for num_threads(_numThreads) schedule(dynamic)
-	for (int i = 0; i < (wm.num_rows()*wm.num_cols()); i++) {
-		//
-		// this solves the work in cell [r][c]:
-		//
-		r = i / wm.num_rows();
-		c = i % wm.num_cols();
-		wm.do_work(r, c);
-
-		//
-		// show some output every 100 cells so we see progress:
-		//
-		#pragma omp atomic
-		cells++;
-
-		if (cells % 100 == 0) {
-			cout << ".";
-			cout.flush();
+
+	if (_strategy == "tasks")
+	{
+		#pragma omp parallel num_threads(_numThreads)
+		#pragma omp single
+		for (int k = 0; k < numTodo; k++) {
+			#pragma omp task
+			Solve(wm, todo[k], checkpoint);
 		}
 	}
+	else if (_strategy == "numa")
+	{
+		RunNuma(wm, todo, checkpoint);
+	}
+	else
+	{
+		omp_sched_t kind = (_strategy == "static") ? omp_sched_static :
+		                   (_strategy == "guided") ? omp_sched_guided : omp_sched_dynamic;
+		omp_set_schedule(kind, 0 /*default chunk size*/);
+
+		#pragma omp parallel for num_threads(_numThreads) schedule(runtime)
+		for (int k = 0; k < numTodo; k++)
+			Solve(wm, todo[k], checkpoint);
+	}
+
+	//
+	// final flush (+ fdatasync): timed on purpose, a run isn't done until
+	// its checkpoint is durable.
+	//
+	delete checkpoint;
   
   auto stop = chrono::high_resolution_clock::now();
   auto diff = stop - start;
@@ -98,6 +161,10 @@ int main(int argc, char *argv[])
 	cout << endl;
 	cout << endl;
 
+	PrintStats(chrono::duration<double>(diff).count());
+
+	TRACE_WRITE("trace.json");
+
   cout << endl;
   cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
 	cout << "** Execution complete **" << endl;
@@ -107,6 +174,192 @@ int main(int argc, char *argv[])
 }
 
 
+//
+// Solve: solves the work in cell i, i.e. [r][c], recording its cost for the
+// statistics (and the result for the checkpoint).
+//
+static void Solve(WorkMatrix& wm, int i, Checkpoint* checkpoint)
+{
+	int r = i / wm.num_cols();
+	int c = i % wm.num_cols();
+	bool result;
+
+	auto start = chrono::steady_clock::now();
+	{
+		TRACE_SCOPE("do_work");
+		result = wm.do_work(r, c);
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	ThreadStats& stats = _stats[omp_get_thread_num()];
+	stats.busy += secs;
+	stats.cells++;
+	if (secs > stats.maxCell)
+		stats.maxCell = secs;
+
+	if (checkpoint != nullptr)
+		checkpoint->complete(i, result);
+
+	//
+	// show some output every 100 cells so we see progress:
+	//
+	int done;
+	#pragma omp atomic capture
+	done = ++cells;
+
+	if (done % 100 == 0) {
+		cout << ".";
+		cout.flush();
+	}
+}
+
+
+//
+// Per-thread queue for the NUMA scheduler: the range [next, end) of the todo
+// list. The owner takes cells from the front, thieves take the back half.
+//
+struct alignas(64) CellQueue {
+	mutex lock;
+	int   next = 0;
+	int   end = 0;
+};
+
+static const int LOCAL_STEAL_TRIES = 4;  // failed local steals before going remote
+
+
+//
+// RunNuma: hierarchical work stealing. Each thread is pinned to its NUMA
+// node and starts with an equal, contiguous share of the cells. An idle
+// thread steals half of a victim's remaining cells, preferring victims on
+// its own node (see VictimSelector in numa.h).
+//
+// OpenMP may start fewer threads than _numThreads, so the placement and the
+// queues are sized for the team we actually get.
+//
+static void RunNuma(WorkMatrix& wm, const vector<int>& todo, Checkpoint* checkpoint)
+{
+	NumaTopology topology;
+	NumaPlacement placement;
+
+	int n = (int) todo.size();
+	int numThreads = 0;
+	vector<CellQueue*> queues;
+	vector<StealStats>& steals = _steals;
+	_numNodes = topology.num_nodes();
+	atomic<int> remaining(n);
+
+	#pragma omp parallel num_threads(_numThreads)
+	{
+		#pragma omp single
+		{
+			numThreads = omp_get_num_threads();
+			placement = NumaPlacement(topology, numThreads);
+			queues.assign(numThreads, nullptr);
+			steals.assign(numThreads, StealStats());
+		}
+
+		int me = omp_get_thread_num();
+		PinnedThread pinned(placement.cpuOf[me]);  // until the end of the region
+
+		// allocated (and first touched) after pinning => node-local memory:
+		CellQueue* mine = new CellQueue();
+		mine->next = (int) ((long) n * me / numThreads);
+		mine->end = (int) ((long) n * (me + 1) / numThreads);
+		queues[me] = mine;
+
+		#pragma omp barrier
+
+		VictimSelector victims(placement, me, LOCAL_STEAL_TRIES);
+
+		while (remaining.load(memory_order_relaxed) > 0)
+		{
+			int k = -1;
+			{
+				lock_guard<mutex> guard(mine->lock);
+				if (mine->next < mine->end)
+					k = mine->next++;
+			}
+
+			if (k >= 0) {
+				Solve(wm, todo[k], checkpoint);
+				remaining--;
+				continue;
+			}
+
+			//
+			// out of work, steal the back half of someone else's cells:
+			//
+			bool remote;
+			int victim = victims.next(remote);
+			if (victim < 0) {  // nobody to steal from:
+				this_thread::yield();
+				continue;
+			}
+
+			int begin = 0, end = 0;
+			{
+				TRACE_SCOPE("steal");
+				CellQueue* theirs = queues[victim];
+				lock_guard<mutex> guard(theirs->lock);
+
+				int avail = theirs->end - theirs->next;
+				if (avail > 0) {
+					end = theirs->end;
+					begin = end - (avail + 1) / 2;
+					theirs->end = begin;
+				}
+			}
+
+			if (begin < end) {
+				lock_guard<mutex> guard(mine->lock);
+				mine->next = begin;
+				mine->end = end;
+
+				if (remote) steals[me].remote++; else steals[me].local++;
+				victims.success();
+			}
+			else {
+				steals[me].failed++;
+				victims.failure(remote);
+				this_thread::yield();
+			}
+		}//while
+
+		// nobody may be looking at our queue when we free it:
+		#pragma omp barrier
+		delete mine;
+	}
+}
+
+
+//
+// PrintStats: one line of per-thread load statistics, in key=value form
+// so bench.sh can parse it. The ideal makespan is bounded below by both
+// busy_sum / threads and the single most expensive cell (task_max).
+//
+static void PrintStats(double wall)
+{
+	double sum = 0.0, max = 0.0, min = 1e300, taskMax = 0.0;
+
+	for (ThreadStats& s : _stats) {
+		sum += s.busy;
+		if (s.busy > max) max = s.busy;
+		if (s.busy < min) min = s.busy;
+		if (s.maxCell > taskMax) taskMax = s.maxCell;
+	}
+
+	cout << "** Stats: threads=" << _numThreads
+	     << " wall=" << wall
+	     << " busy_sum=" << sum
+	     << " busy_max=" << max
+	     << " busy_min=" << min
+	     << " task_max=" << taskMax << endl;
+
+	if (!_steals.empty())
+		PrintStealStats(_steals, _numNodes);
+}
+
+
 //
 // processCmdLineArgs:
 //
@@ -117,7 +370,7 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-s Strategy] [-c CheckpointFile]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
@@ -125,10 +378,27 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc))  // scheduling strategy:
+		{
+			i++;
+			_strategy = argv[i];
+			if (_strategy != "static" && _strategy != "dynamic" &&
+			    _strategy != "guided" && _strategy != "tasks" && _strategy != "numa")
+			{
+				cout << "**Unknown strategy: '" << argv[i] << "'" << endl;
+				cout << "**Strategies: static, dynamic, guided, tasks, numa" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-c") == 0) && (i+1 < argc))  // checkpoint file:
+		{
+			i++;
+			_checkpointFile = argv[i];
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-s Strategy] [-c CheckpointFile]" << endl << endl;
 			exit(0);
 		}
 
@@ -0,0 +1,95 @@
+/*costprofile.h*/
+
+//
+// Persistent per-vertex cost profile for repeated traversals of the same
+// WorkGraph: what do_work cost for each vertex last time. The priority
+// engine uses it to start known-heavy vertices first, so a heavy vertex
+// no longer becomes the tail of the run just because it's found late.
+//
+// Profile file format (native byte order):
+//   header:  "WGCP", # of vertices, start vertex      (3 x 4 bytes)
+//   records: vertex id, cost in microseconds          (int32 + float)
+// A profile of a different graph (other size or start vertex) is ignored,
+// which is every profile with the prebuilt workgraph.o: it generates a new
+// random graph each run. Only graphs that repeat (workgraph-synth.cpp with
+// the same WG_SEED) get any use out of a profile.
+// The file is replaced via a temp file and rename, so it's always valid.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+static const char COST_PROFILE_MAGIC[4] = { 'W', 'G', 'C', 'P' };
+
+struct CostRecord {
+  int32_t vertex;
+  float   us;
+};
+
+
+//
+// LoadCostProfile: reads the records of a profile for the given graph;
+// returns false (and no records) if there is none or it's for another graph.
+//
+inline bool LoadCostProfile(const std::string& filename, int numVertices, int startVertex,
+                            std::vector<CostRecord>& records)
+{
+  records.clear();
+
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == nullptr)
+    return false;
+
+  char magic[4];
+  int32_t header[2];
+  bool ok = fread(magic, sizeof(magic), 1, f) == 1
+         && fread(header, sizeof(header), 1, f) == 1
+         && memcmp(magic, COST_PROFILE_MAGIC, sizeof(magic)) == 0
+         && header[0] == numVertices && header[1] == startVertex;
+
+  CostRecord r;
+  while (ok && (int) records.size() < numVertices && fread(&r, sizeof(r), 1, f) == 1)
+    records.push_back(r);
+
+  fclose(f);
+  return ok;
+}
+
+
+//
+// SaveCostProfile: replaces the profile with the given records; returns
+// false on error.
+//
+inline bool SaveCostProfile(const std::string& filename, int numVertices, int startVertex,
+                            const std::vector<CostRecord>& records)
+{
+  std::string temp = filename + ".tmp";
+
+  FILE* f = fopen(temp.c_str(), "wb");
+  if (f == nullptr) {
+    std::cout << "**Error: unable to create '" << temp << "'" << std::endl;
+    return false;
+  }
+
+  int32_t header[2] = { numVertices, startVertex };
+  bool ok = fwrite(COST_PROFILE_MAGIC, sizeof(COST_PROFILE_MAGIC), 1, f) == 1
+         && fwrite(header, sizeof(header), 1, f) == 1
+         && fwrite(records.data(), sizeof(CostRecord), records.size(), f) == records.size();
+
+  ok = (fclose(f) == 0) && ok;
+  ok = ok && (rename(temp.c_str(), filename.c_str()) == 0);
+
+  if (!ok) {
+    std::cout << "**Error: unable to write '" << filename << "'" << std::endl;
+    remove(temp.c_str());
+  }
+
+  return ok;
+}
@@ -0,0 +1,220 @@
+/*csr.h*/
+
+//
+// Compact (CSR) snapshot of a discovered WorkGraph, so the structure only
+// has to be paid for with WorkGraph::do_work once. WriteCsr renumbers the
+// vertices densely (0..N-1, in BFS order from the start vertex, for
+// locality) and writes the file; CsrGraph maps a file back into memory
+// read-only, ready to traverse without any copying or parsing.
+//
+// File layout (native byte order, every array 8-byte aligned):
+//
+//   CsrHeader                    magic "WGCSR1", N, M, start (dense)
+//   uint64_t offsets[N + 1]      neighbors of v are targets[offsets[v] .. offsets[v+1])
+//   int32_t  ids[N]              dense => original vertex id
+//   [padding to 8 bytes]
+//   uint32_t targets[M]          dense neighbor ids
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct CsrHeader {
+  char     magic[8];   // "WGCSR1"
+  uint64_t vertices;
+  uint64_t edges;
+  uint64_t start;
+};
+
+static const char CSR_MAGIC[8] = "WGCSR1";
+
+inline uint64_t CsrIdsBytes(uint64_t n)
+{
+  return (n * sizeof(int32_t) + 7) / 8 * 8;  // padded, keeps targets aligned
+}
+
+
+//
+// WriteCsr: writes the graph given as vertex ids and their neighbor lists
+// (neighbors[i] are the neighbors of vertices[i]). Every neighbor must be
+// one of the vertices, i.e. the traversal must have completed. Returns
+// false on error.
+//
+inline bool WriteCsr(const std::string& filename, int start,
+                     const std::vector<int>& vertices,
+                     const std::vector<const std::vector<int>*>& neighbors)
+{
+  size_t n = vertices.size();
+
+  std::unordered_map<int, size_t> position;  // original id => index in vertices
+  position.reserve(n);
+  for (size_t i = 0; i < n; i++)
+    position.emplace(vertices[i], i);
+
+  //
+  // dense ids in BFS order from the start vertex:
+  //
+  const uint32_t NONE = UINT32_MAX;
+  std::vector<uint32_t> dense(n, NONE);
+  std::vector<size_t> order;  // dense => index in vertices
+  order.reserve(n);
+
+  auto it = position.find(start);
+  if (it == position.end()) {
+    std::cout << "**Error: start vertex was not captured" << std::endl;
+    return false;
+  }
+
+  dense[it->second] = 0;
+  order.push_back(it->second);
+
+  for (size_t head = 0; head < order.size(); head++)
+    for (int w : *neighbors[order[head]]) {
+      auto pos = position.find(w);
+      if (pos == position.end()) {
+        std::cout << "**Error: vertex " << w << " was not captured, traversal incomplete?" << std::endl;
+        return false;
+      }
+      if (dense[pos->second] == NONE) {
+        dense[pos->second] = (uint32_t) order.size();
+        order.push_back(pos->second);
+      }
+    }
+
+  //
+  // build the arrays:
+  //
+  std::vector<uint64_t> offsets(order.size() + 1, 0);
+  std::vector<int32_t> ids(order.size());
+  std::vector<uint32_t> targets;
+
+  for (size_t v = 0; v < order.size(); v++) {
+    ids[v] = vertices[order[v]];
+    for (int w : *neighbors[order[v]])
+      targets.push_back(dense[position[w]]);
+    offsets[v + 1] = targets.size();
+  }
+
+  CsrHeader header;
+  memcpy(header.magic, CSR_MAGIC, sizeof(header.magic));
+  header.vertices = order.size();
+  header.edges = targets.size();
+  header.start = 0;
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cout << "**Error: unable to create '" << filename << "'" << std::endl;
+    return false;
+  }
+
+  uint64_t padding = 0;
+  size_t pad = CsrIdsBytes(ids.size()) - ids.size() * sizeof(int32_t);
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+         && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size()
+         && fwrite(ids.data(), sizeof(int32_t), ids.size(), file) == ids.size()
+         && fwrite(&padding, 1, pad, file) == pad
+         && fwrite(targets.data(), sizeof(uint32_t), targets.size(), file) == targets.size();
+
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok)
+    std::cout << "**Error: unable to write '" << filename << "'" << std::endl;
+
+  return ok;
+}
+
+
+//
+// CsrGraph: a CSR file mapped read-only into memory.
+//
+class CsrGraph {
+  public:
+    CsrGraph() : Base(nullptr), Bytes(0), Header(nullptr),
+                 Offsets(nullptr), Ids(nullptr), Targets(nullptr) { }
+
+    ~CsrGraph()
+    {
+      if (Base != nullptr)
+        munmap(Base, Bytes);
+    }
+
+    CsrGraph(const CsrGraph&) = delete;
+    CsrGraph& operator=(const CsrGraph&) = delete;
+
+    //
+    // open: maps the file; returns false (with a message) if it can't be
+    // mapped or isn't a valid CSR file.
+    //
+    bool open(const std::string& filename)
+    {
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        std::cout << "**Error: unable to open '" << filename << "'" << std::endl;
+        return false;
+      }
+
+      struct stat st;
+      if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(CsrHeader)) {
+        std::cout << "**Error: '" << filename << "' is not a CSR file" << std::endl;
+        ::close(fd);
+        return false;
+      }
+
+      Bytes = st.st_size;
+      Base = mmap(nullptr, Bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);  // the mapping stays valid
+
+      if (Base == MAP_FAILED) {
+        Base = nullptr;
+        std::cout << "**Error: unable to map '" << filename << "'" << std::endl;
+        return false;
+      }
+
+      Header = (const CsrHeader*) Base;
+      uint64_t n = Header->vertices, m = Header->edges;
+
+      if (memcmp(Header->magic, CSR_MAGIC, sizeof(CSR_MAGIC)) != 0 ||
+          Bytes != sizeof(CsrHeader) + (n + 1) * sizeof(uint64_t) + CsrIdsBytes(n) + m * sizeof(uint32_t)) {
+        std::cout << "**Error: '" << filename << "' is not a valid CSR file" << std::endl;
+        return false;
+      }
+
+      const char* p = (const char*) Base + sizeof(CsrHeader);
+      Offsets = (const uint64_t*) p;
+      Ids = (const int32_t*) (p + (n + 1) * sizeof(uint64_t));
+      Targets = (const uint32_t*) (p + (n + 1) * sizeof(uint64_t) + CsrIdsBytes(n));
+
+      return true;
+    }
+
+    uint64_t num_vertices() const { return Header->vertices; }
+    uint64_t num_edges() const { return Header->edges; }
+    uint32_t start() const { return (uint32_t) Header->start; }
+
+    // id: the original WorkGraph id of dense vertex v.
+    int id(uint32_t v) const { return Ids[v]; }
+
+    // neighbors of dense vertex v are [begin(v), end(v)):
+    const uint32_t* begin(uint32_t v) const { return Targets + Offsets[v]; }
+    const uint32_t* end(uint32_t v) const { return Targets + Offsets[v + 1]; }
+
+  private:
+    void*            Base;
+    size_t           Bytes;
+    const CsrHeader* Header;
+    const uint64_t*  Offsets;
+    const int32_t*   Ids;
+    const uint32_t*  Targets;
+};
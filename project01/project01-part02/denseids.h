@@ -0,0 +1,238 @@
+/*denseids.h*/
+
+//
+// Dense vertex ids for the WorkGraph traversal. WorkGraph identifies
+// vertices by random ints, which forces hashing whenever something is
+// looked up per vertex. DenseIds interns each id the first time it's
+// seen and gives it the next index 0, 1, 2, ...; from then on per-vertex
+// data can live in flat arrays indexed by it. DenseVisited builds the
+// visited set on top: one bit per dense index, claimed with a single
+// atomic fetch_or.
+//
+// Interning is an open-addressing (linear probing) table of 64-bit slots,
+// the id in the low half and its index + 1 in the high half (0 = empty).
+// The thread that claims an empty slot (via CAS) marks it BUSY, takes the
+// next index from a counter and then publishes it; anyone looking up the
+// same id meanwhile waits the few instructions that takes. So indices
+// are handed out without holes, exactly one per distinct id.
+//
+// The tables don't grow: capacity is the most ids that can be interned
+// (WorkGraph::num_vertices() is exact), and exceeding it is fatal.
+//
+
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+
+class DenseIds {
+  public:
+    explicit DenseIds(size_t capacity = 1024)
+      : Slots(nullptr), Ids(nullptr)
+    {
+      init(capacity);
+    }
+
+    ~DenseIds()
+    {
+      delete[] Slots;
+      delete[] Ids;
+    }
+
+    DenseIds(const DenseIds&) = delete;
+    DenseIds& operator=(const DenseIds&) = delete;
+
+    //
+    // intern: the dense index of the vertex, assigning the next one if the
+    // vertex is new (then "fresh" is set). Safe to call from any thread.
+    //
+    uint32_t intern(int vertex, bool& fresh)
+    {
+      uint32_t key = (uint32_t) vertex;
+      fresh = false;
+
+      for (size_t i = hash(key) & Mask; ; i = (i + 1) & Mask)
+      {
+        uint64_t slot = Slots[i].load(std::memory_order_acquire);
+
+        if (slot == 0)
+        {
+          uint64_t busy = (BUSY << 32) | key;
+          if (Slots[i].compare_exchange_strong(slot, busy, std::memory_order_acq_rel))
+          {
+            uint32_t index = Count.fetch_add(1);
+            if (index >= Capacity) {
+              std::cout << "**Error: more than " << Capacity << " vertex ids interned" << std::endl;
+              exit(1);
+            }
+
+            Ids[index] = vertex;
+            Slots[i].store(((uint64_t) (index + 1) << 32) | key, std::memory_order_release);
+            fresh = true;
+            return index;
+          }
+          // lost the race; slot now holds whatever the winner wrote:
+        }
+
+        if ((uint32_t) slot == key)
+        {
+          while ((slot >> 32) == BUSY)  // winner is still taking an index:
+            slot = Slots[i].load(std::memory_order_acquire);
+
+          return (uint32_t) (slot >> 32) - 1;
+        }
+      }
+    }
+
+    uint32_t intern(int vertex)
+    {
+      bool fresh;
+      return intern(vertex, fresh);
+    }
+
+    // size: # of ids interned.
+    uint32_t size() const { return Count.load(); }
+
+    // capacity: most ids that can be interned.
+    size_t capacity() const { return Capacity; }
+
+    // id: the original vertex id of a dense index < size().
+    int id(uint32_t index) const { return Ids[index]; }
+
+    //
+    // reset: forgets all ids, sized for the given capacity. NOT
+    // thread-safe, call between traversals.
+    //
+    void reset(size_t capacity)
+    {
+      delete[] Slots;
+      delete[] Ids;
+      init(capacity);
+    }
+
+  private:
+    static const uint64_t BUSY = 0xFFFFFFFF;
+
+    std::atomic<uint64_t>* Slots;
+    size_t                 Mask;      // # of slots - 1
+    size_t                 Capacity;
+    std::atomic<uint32_t>  Count{0};
+    int*                   Ids;       // dense index => id
+
+    // hash: murmur3's finalizer.
+    static uint32_t hash(uint32_t x)
+    {
+      x ^= x >> 16;
+      x *= 0x85ebca6b;
+      x ^= x >> 13;
+      x *= 0xc2b2ae35;
+      x ^= x >> 16;
+      return x;
+    }
+
+    void init(size_t capacity)
+    {
+      Capacity = (capacity > 0) ? capacity : 1;
+
+      // at most 50% load:
+      size_t n = 16;
+      while (n < 2 * Capacity)
+        n *= 2;
+
+      Slots = new std::atomic<uint64_t>[n];
+      for (size_t i = 0; i < n; i++)
+        Slots[i].store(0, std::memory_order_relaxed);
+      Mask = n - 1;
+
+      Ids = new int[Capacity];
+      Count.store(0);
+    }
+};
+
+
+//
+// DenseVisited: a visited set over interned ids, one bit per vertex. It has
+// the same try_visit / size / reset interface as VisitedSet (visitedset.h),
+// and also hands out the dense index of a vertex for per-vertex arrays.
+//
+class DenseVisited {
+  public:
+    explicit DenseVisited(size_t capacity = 1024)
+      : Bits(nullptr)
+    {
+      init(capacity);
+    }
+
+    ~DenseVisited() { delete[] Bits; }
+
+    DenseVisited(const DenseVisited&) = delete;
+    DenseVisited& operator=(const DenseVisited&) = delete;
+
+    //
+    // try_visit: marks the vertex as visited; returns true if this call did
+    // so, false if it was already visited. Safe to call from any thread.
+    //
+    bool try_visit(int vertex)
+    {
+      uint32_t index = Ids.intern(vertex);
+      uint64_t bit = 1ull << (index % 64);
+
+      return (Bits[index / 64].fetch_or(bit, std::memory_order_acq_rel) & bit) == 0;
+    }
+
+    // index: the dense index of the vertex (interned if need be).
+    uint32_t index(int vertex) { return Ids.intern(vertex); }
+
+    // ids: the interning table, e.g. to map indices back to vertex ids.
+    const DenseIds& ids() const { return Ids; }
+
+    //
+    // size: # of visited vertices (exact once the visiting threads are done).
+    //
+    size_t size() const
+    {
+      size_t total = 0;
+      for (size_t w = 0; w < Words; w++)
+        total += __builtin_popcountll(Bits[w].load(std::memory_order_relaxed));
+      return total;
+    }
+
+    //
+    // reset: forgets ids and visits, sized for the given capacity. NOT
+    // thread-safe, call between traversals.
+    //
+    void reset(size_t capacity)
+    {
+      delete[] Bits;
+      Ids.reset(capacity);
+      init(capacity);
+    }
+
+    //
+    // clear_visits: forgets the visits but keeps the ids, so per-vertex
+    // arrays stay valid across traversals. NOT thread-safe.
+    //
+    void clear_visits()
+    {
+      for (size_t w = 0; w < Words; w++)
+        Bits[w].store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    DenseIds               Ids;
+    std::atomic<uint64_t>* Bits;
+    size_t                 Words;
+
+    void init(size_t capacity)
+    {
+      if (Ids.capacity() != capacity)
+        Ids.reset(capacity);
+
+      Words = (Ids.capacity() + 63) / 64;
+      Bits = new std::atomic<uint64_t>[Words];
+      clear_visits();
+    }
+};
@@ -0,0 +1,455 @@
+/* main-mpi.cpp */
+
+//
+// Distributed traversal of the "work graph" over MPI, so the work can
+// spread beyond one node's cores. Every rank builds the same WorkGraph;
+// vertex v is owned by rank hash(v) % P, and only its owner visits it.
+//
+// Usage:
+//   mpiexec -n P work-mpi [-?] [-b BatchSize] [-f FlushMillisecs]
+//
+// A rank works through its queue of owned vertices. Neighbors it owns
+// itself go straight into its visited set and queue. The others are
+// appended to a per-destination buffer, sent with MPI_Isend once it holds
+// BatchSize vertices (default 256) or when the oldest buffered vertex is
+// FlushMillisecs old (default 1). The owner dedups incoming vertices
+// against its own visited set. An idle rank sends all its buffers at once.
+//
+// Termination: whenever a rank is idle (empty queue, nothing buffered) it
+// joins a non-blocking allreduce ("wave") of the # of messages sent and
+// received so far. It keeps receiving and working while the wave is in
+// progress. The traversal is done once two consecutive waves both see
+// sent == received with unchanged totals (Mattern's four-counter method).
+//
+// The graph must be identical on every rank; the prebuilt workgraph.o
+// generates it randomly per process, so use "make mpi-synth" (seeded,
+// see workgraph-synth.cpp) unless workgraph.o is known to be
+// deterministic. A mismatch is detected at startup.
+//
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+
+#include "workgraph.h"
+#include "visitedset.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// Globals:
+//
+static int _batchSize = 256;     // vertices per message
+static double _flushSecs = 0.001;
+
+static const int TAG_VERTICES = 1;
+
+//
+// Per-rank statistics:
+//
+struct RankStats {
+	long vertices = 0;     // visited (worked on) by this rank
+	long localEdges = 0;   // neighbors owned by this rank
+	long remoteEdges = 0;  // neighbors sent to their owner
+	long messages = 0;     // messages sent
+	long received = 0;     // vertices received
+	long duplicates = 0;   // received vertices that were already visited
+	long waves = 0;        // termination waves joined
+	double busy = 0.0;     // secs spent in WorkGraph::do_work
+};
+
+//
+// Function prototypes:
+//
+static void ProcessCmdLineArgs(int argc, char* argv[], int myRank);
+static void PrintStats(const RankStats& stats, double wall, int myRank, int numProcs, int numVertices);
+
+
+//
+// Owner: the rank that visits the given vertex; murmur3's finalizer, so
+// the owners are balanced whatever the ids look like.
+//
+static int Owner(int vertex, int numProcs)
+{
+	uint32_t x = (uint32_t) vertex;
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return (int) (x % (uint32_t) numProcs);
+}
+
+
+//
+// Outbox: the vertices bound for each other rank, and the sends in flight
+// (their buffers must live until MPI is done with them).
+//
+class Outbox {
+	public:
+		Outbox(int numProcs, RankStats& stats)
+			: Buffers(numProcs), Oldest(numProcs), Stats(stats) { }
+
+		// add: buffers a vertex for its owner, sending the buffer once full:
+		void add(int dest, int vertex)
+		{
+			if (Buffers[dest].empty())
+				Oldest[dest] = chrono::steady_clock::now();
+
+			Buffers[dest].push_back(vertex);
+			Stats.remoteEdges++;
+
+			if ((int) Buffers[dest].size() >= _batchSize)
+				send(dest);
+		}
+
+		// flush: sends buffers that are old enough, or all if "all":
+		void flush(bool all)
+		{
+			auto now = chrono::steady_clock::now();
+
+			for (int dest = 0; dest < (int) Buffers.size(); dest++)
+				if (!Buffers[dest].empty() &&
+				    (all || chrono::duration<double>(now - Oldest[dest]).count() >= _flushSecs))
+					send(dest);
+		}
+
+		// progress: frees the buffers of completed sends:
+		void progress()
+		{
+			for (size_t i = 0; i < InFlight.size(); )
+			{
+				int done = 0;
+				MPI_Test(&InFlight[i].request, &done, MPI_STATUS_IGNORE);
+
+				if (done) {
+					swap(InFlight[i], InFlight.back());
+					InFlight.pop_back();
+				}
+				else
+					i++;
+			}
+		}
+
+		// drain: waits for all sends to complete:
+		void drain()
+		{
+			for (Send& s : InFlight)
+				MPI_Wait(&s.request, MPI_STATUS_IGNORE);
+			InFlight.clear();
+		}
+
+	private:
+		struct Send {
+			MPI_Request request;
+			vector<int> vertices;
+		};
+
+		vector<vector<int>> Buffers;
+		vector<chrono::steady_clock::time_point> Oldest;
+		vector<Send> InFlight;
+		RankStats& Stats;
+
+		void send(int dest)
+		{
+			TRACE_SCOPE("send");
+
+			InFlight.push_back(Send());
+			Send& s = InFlight.back();
+			s.vertices.swap(Buffers[dest]);
+
+			MPI_Isend(s.vertices.data(), (int) s.vertices.size(), MPI_INT, dest, TAG_VERTICES,
+			          MPI_COMM_WORLD, &s.request);
+			Stats.messages++;
+		}
+};
+
+
+//
+// Traverse: this rank's part of the distributed traversal.
+//
+static void Traverse(WorkGraph& wg, int myRank, int numProcs, RankStats& stats)
+{
+	VisitedSet visited(wg.num_vertices() / numProcs + 1);
+	deque<int> queue;
+	Outbox outbox(numProcs, stats);
+	vector<int> incoming;
+
+	int start = wg.start_vertex();
+	if (Owner(start, numProcs) == myRank) {
+		visited.try_visit(start);
+		queue.push_back(start);
+	}
+
+	// termination waves, of the # of messages sent and received; the
+	// counts must not change while a wave is using them, hence the copy:
+	long messagesIn = 0;
+	long counts[2], totals[2], previous[2] = { -1, -1 };
+	MPI_Request wave = MPI_REQUEST_NULL;
+
+	for (;;)
+	{
+		//
+		// 1. receive whatever has arrived:
+		//
+		for (;;)
+		{
+			int arrived = 0;
+			MPI_Status status;
+			MPI_Iprobe(MPI_ANY_SOURCE, TAG_VERTICES, MPI_COMM_WORLD, &arrived, &status);
+			if (!arrived)
+				break;
+
+			int count;
+			MPI_Get_count(&status, MPI_INT, &count);
+			incoming.resize(count);
+			MPI_Recv(incoming.data(), count, MPI_INT, status.MPI_SOURCE, TAG_VERTICES,
+			         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+			messagesIn++;
+			stats.received += count;
+
+			for (int vertex : incoming)
+				if (visited.try_visit(vertex))
+					queue.push_back(vertex);
+				else
+					stats.duplicates++;
+		}
+
+		//
+		// 2. work on one vertex:
+		//
+		if (!queue.empty())
+		{
+			int vertex = queue.front();
+			queue.pop_front();
+
+			auto begin = chrono::steady_clock::now();
+			vector<int> neighbors;
+			{
+				TRACE_SCOPE("do_work");
+				neighbors = wg.do_work(vertex);
+			}
+			stats.busy += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+			stats.vertices++;
+
+			for (int neighbor : neighbors)
+			{
+				int owner = Owner(neighbor, numProcs);
+
+				if (owner != myRank)
+					outbox.add(owner, neighbor);
+				else {
+					stats.localEdges++;
+					if (visited.try_visit(neighbor))
+						queue.push_back(neighbor);
+				}
+			}
+
+			outbox.flush(false);
+			outbox.progress();
+			continue;
+		}
+
+		//
+		// 3. idle: send everything, then take part in termination detection:
+		//
+		outbox.flush(true);
+		outbox.progress();
+
+		if (wave == MPI_REQUEST_NULL)
+		{
+			counts[0] = stats.messages;
+			counts[1] = messagesIn;
+			MPI_Iallreduce(counts, totals, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD, &wave);
+			stats.waves++;
+		}
+
+		int done = 0;
+		MPI_Test(&wave, &done, MPI_STATUS_IGNORE);
+
+		if (done)  // wave is now MPI_REQUEST_NULL again:
+		{
+			if (totals[0] == totals[1] && totals[0] == previous[0] && totals[1] == previous[1])
+				break;
+
+			previous[0] = totals[0];
+			previous[1] = totals[1];
+		}
+	}//for
+
+	outbox.drain();
+}
+
+
+//
+// main:
+//
+int main(int argc, char *argv[])
+{
+	int myRank, numProcs;
+
+	MPI_Init(&argc, &argv);
+	MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+	TRACE_INIT();  // line up the ranks' trace timelines
+
+	ProcessCmdLineArgs(argc, argv, myRank);
+
+	WorkGraph wg;  // NOTE: wg MUST be created in sequential code
+
+	//
+	// every rank must have the same graph:
+	//
+	int mine[2] = { wg.num_vertices(), wg.start_vertex() };
+	int root[2] = { mine[0], mine[1] };
+	MPI_Bcast(root, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+	int differs = (mine[0] != root[0] || mine[1] != root[1]), anyDiffers;
+	MPI_Allreduce(&differs, &anyDiffers, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+
+	if (anyDiffers)
+	{
+		if (myRank == 0)
+			cout << "**Error: the ranks generated different graphs, use a deterministic WorkGraph (make mpi-synth)" << endl;
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (myRank == 0)
+	{
+		cout << "** Work Graph Application (MPI) **" << endl;
+		cout << endl;
+		cout << "Graph size:   " << wg.num_vertices() << " vertices" << endl;
+		cout << "Start vertex: " << wg.start_vertex() << endl;
+		cout << "# of ranks:   " << numProcs << endl;
+		cout << "Batch size:   " << _batchSize << endl;
+		cout << endl;
+		cout << "working...";
+		cout.flush();
+	}
+
+	RankStats stats;
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	auto start = chrono::high_resolution_clock::now();
+
+	Traverse(wg, myRank, numProcs, stats);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	auto stop = chrono::high_resolution_clock::now();
+	auto diff = stop - start;
+	auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
+
+	if (myRank == 0) {
+		cout << endl;
+		cout << endl;
+	}
+
+	PrintStats(stats, chrono::duration<double>(diff).count(), myRank, numProcs, wg.num_vertices());
+
+	TRACE_WRITE("trace.json");
+
+	if (myRank == 0)
+	{
+		cout << endl;
+		cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
+		cout << "** Execution complete **" << endl;
+		cout << endl;
+	}
+
+	MPI_Finalize();
+	return 0;
+}
+
+
+//
+// PrintStats: (rank 0) totals over the ranks, in key=value form. Batching
+// efficiency is the average message size relative to BatchSize.
+//
+static void PrintStats(const RankStats& stats, double wall, int myRank, int numProcs, int numVertices)
+{
+	long mine[7] = { stats.vertices, stats.localEdges, stats.remoteEdges, stats.messages,
+	                 stats.received, stats.duplicates, stats.waves };
+	long sums[7];
+
+	// max of x and of -x => max and min:
+	double busy[2] = { stats.busy, -stats.busy }, busyMax[2];
+	long vertices[2] = { stats.vertices, -stats.vertices }, verticesMax[2];
+	double busySum;
+
+	MPI_Reduce(mine, sums, 7, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(busy, busyMax, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(vertices, verticesMax, 2, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&stats.busy, &busySum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	if (myRank != 0)
+		return;
+
+	long visited = sums[0], local = sums[1], remote = sums[2], messages = sums[3];
+	long received = sums[4], duplicates = sums[5];
+
+	if (visited != numVertices)
+		cout << "**WARNING: visited " << visited << " of " << numVertices << " vertices" << endl;
+
+	double perMessage = (messages > 0) ? (double) received / messages : 0.0;
+
+	cout << "** Stats: ranks=" << numProcs
+	     << " wall=" << wall
+	     << " busy_sum=" << busySum
+	     << " busy_max=" << busyMax[0]
+	     << " busy_min=" << -busyMax[1]
+	     << " vertices_max=" << verticesMax[0]
+	     << " vertices_min=" << -verticesMax[1] << endl;
+
+	cout << "** Messages: local_edges=" << local
+	     << " remote_edges=" << remote
+	     << " remote_pct=" << ((local + remote > 0) ? 100.0 * remote / (local + remote) : 0.0)
+	     << " messages=" << messages
+	     << " bytes=" << received * (long) sizeof(int)
+	     << " vertices_per_msg=" << perMessage
+	     << " batch_eff_pct=" << 100.0 * perMessage / _batchSize
+	     << " duplicates=" << duplicates
+	     << " waves_max=" << sums[6] / numProcs << endl;
+}
+
+
+//
+// processCmdLineArgs:
+//
+static void ProcessCmdLineArgs(int argc, char* argv[], int myRank)
+{
+	for (int i = 1; i < argc; i++)
+	{
+
+		if ((strcmp(argv[i], "-b") == 0) && (i+1 < argc))  // vertices per message:
+		{
+			i++;
+			_batchSize = std::max(1, atoi(argv[i]));
+		}
+		else if ((strcmp(argv[i], "-f") == 0) && (i+1 < argc))  // flush age:
+		{
+			i++;
+			_flushSecs = atof(argv[i]) / 1000.0;
+		}
+		else  // help, or error: unknown arg
+		{
+			if (myRank == 0) {
+				if (strcmp(argv[i], "-?") != 0)
+					cout << "**Unknown argument: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mpiexec -n P work-mpi [-?] [-b BatchSize] [-f FlushMillisecs]" << endl << endl;
+			}
+			MPI_Finalize();
+			exit(0);
+		}
+
+	}//for
+}
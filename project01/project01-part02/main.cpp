@@ -7,7 +7,36 @@
 // dynamic solution is needed.
 // 
 // Usage:
-//   work [-?] [-t NumThreads]
+//   work [-?] [-t NumThreads] [-s Strategy] [-b Batch] [-p MaxPending] [-d MaxDepth]
+//        [-w CaptureFile] [-c CostProfile] [-v]
+//
+// Strategy selects the traversal engine: tasks (one OpenMP task per
+// discovered neighbor, the default), numa (hierarchical work stealing
+// over per-thread vertex queues, see numa.h), frontier (level by level,
+// breadth-first), actor (owner computes: each vertex belongs to one
+// thread, which alone visits it; see RunActors) or priority (known-heavy
+// vertices first, see RunPriority).
+//
+// Task granularity (tasks strategy): each task works on a batch of up to
+// Batch claimed vertices (default 4; for actor, Batch is the # of vertices
+// per message, default 64). Once MaxPending tasks are queued
+// (default 8 per thread), or tasks are nested MaxDepth deep (default 0,
+// no limit), newly found vertices are worked on inline instead.
+//
+// -w records the discovered edges while traversing (with any strategy)
+// and writes them as a CSR file, see csr.h; "csrreplay CaptureFile" then
+// traverses the graph without redoing the vertex work.
+//
+// -c keeps a per-vertex cost profile across runs of the same graph (see
+// costprofile.h): it's loaded at startup if it exists, and rewritten with
+// the costs measured by this run at the end. NOTE: the prebuilt
+// workgraph.o generates a new random graph every run, so its profile
+// never matches the next run (a warning says so); use "make synth", whose
+// graph is the same for the same WG_SEED (see workgraph-synth.cpp).
+//
+// At exit a contention report breaks the threads' time down into do_work,
+// waiting for queue locks, creating tasks and the rest (idle / overhead),
+// and names the largest; -v adds a per-thread table.
 //
 // Author:
 //   <<Your Name>>
@@ -24,12 +53,22 @@
 #include <vector>
 #include <chrono>
 #include <random>
-#include <unordered_set>
+#include <algorithm>
+#include <iomanip>
 #include <sys/sysinfo.h>
 #include <omp.h>
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <unordered_set>
 
 #include "workgraph.h"
+#include "trace.h"
+#include "numa.h"
+#include "denseids.h"
+#include "csr.h"
+#include "costprofile.h"
 
 using namespace std;
 
@@ -38,41 +77,310 @@ using namespace std;
 // Globals:
 //
 static int _numThreads = 1;  // default to sequential execution
-static std::mutex visited_mutex;   
-static std::unordered_set<int> visited;
+static DenseVisited visited;  // interned ids + bitmap, see denseids.h
+static string _strategy = "tasks";
+static int _batch = 0;         // vertices per task / message, 0 => default
+static int _maxPending = 0;    // 0 => 8 per thread
+static int _maxDepth = 0;      // 0 => unlimited
+static atomic<int> _pending(0);  // tasks created but not yet finished
+static string _captureFile;      // "" => no capture
+static string _profileFile;      // "" => no cost profile
+static bool _verbose = false;    // per-thread report
+static vector<float> _profile;   // profiled cost (us) by dense index, 0 = unknown
+static vector<float> _measured;  // cost (us) measured by this run, likewise
+static chrono::steady_clock::time_point _t0;  // start of the traversal
+
+//
+// Per-thread statistics, padded so threads don't share cache lines:
+//
+struct alignas(64) ThreadStats {
+	double busy = 0.0;       // secs spent in WorkGraph::do_work
+	double maxVertex = 0.0;  // most expensive vertex
+	double maxStart = 0.0;   // when it was started, secs into the traversal
+	int    vertices = 0;
+	long   tasks = 0;        // tasks created (tasks engine only)
+	long   executed = 0;     // tasks run
+	long   inlined = 0;      // vertices worked on inline due to a cutoff
+	int    maxPending = 0;   // most tasks pending at a creation
+	double spawn = 0.0;      // secs spent creating tasks
+	long   duplicates = 0;   // vertices rejected as already visited
+	long   locks = 0;        // queue lock acquisitions
+	long   contended = 0;    // ... that had to wait
+	double lockWait = 0.0;   // secs spent waiting for them
+};
+
+static vector<ThreadStats> _stats;
+
+//
+// Per-thread record of the discovered edges (-w), padded likewise:
+//
+struct alignas(64) CaptureBuffer {
+	vector<int>         vertices;
+	vector<vector<int>> neighbors;
+};
+
+static vector<CaptureBuffer> _captured;
+static vector<StealStats>  _steals;  // NUMA engine only
+static int                 _numNodes = 0;
+static int                 _levels = 0;     // frontier engine only
+static size_t              _maxWidth = 0;
+
+//
+// Per-thread message statistics of the actor engine:
+//
+struct alignas(64) ActorStats {
+	long messages = 0;    // messages sent to other threads
+	long routed = 0;      // vertices sent to their owner
+	long local = 0;       // neighbors this thread owns itself
+};
+
+static vector<ActorStats> _actors;
 
 //
 // Function prototypes:
 //
 static void ProcessCmdLineArgs(int argc, char* argv[]);
+static void PrintStats(double wall);
+static void PrintContention(double wall);
+static void WriteCapture(WorkGraph& wg);
+static void LoadProfile(WorkGraph& wg);
+static void SaveProfile(WorkGraph& wg);
+static void RunPriority(WorkGraph& wg);
+static void RunNuma(WorkGraph& wg);
+static void RunFrontier(WorkGraph& wg);
+static void RunActors(WorkGraph& wg);
 
-// Here we parallelize the BFS traversal using recursion
-// The idea is to visit all reachable vertices in parallel 
-// until we exhaust all the threads
+//
+// Claim: marks the vertex as visited; false (and counted) if it already was.
+//
+static bool Claim(int vertex)
+{
+	if (visited.try_visit(vertex))
+		return true;
 
-// If the vertex was already visited, immediately return avoiding
-// redundant processing
+	_stats[omp_get_thread_num()].duplicates++;
+	return false;
+}
 
-// Since multiple threads access the visited set, its access must be  
-// protected using a mutex
-void do_work(WorkGraph& wg, int vertex) 
+//
+// TimedLock: lock_guard for the engines' queue locks that also records
+// how often, and how long, threads had to wait. The uncontended case
+// costs one try_lock, no clock reads.
+//
+class TimedLock {
+	public:
+		explicit TimedLock(mutex& m) : M(m)
+		{
+			ThreadStats& stats = _stats[omp_get_thread_num()];
+			stats.locks++;
+
+			if (!M.try_lock()) {
+				auto start = chrono::steady_clock::now();
+				M.lock();
+				stats.lockWait += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+				stats.contended++;
+			}
+		}
+
+		~TimedLock() { M.unlock(); }
+
+		TimedLock(const TimedLock&) = delete;
+		TimedLock& operator=(const TimedLock&) = delete;
+
+	private:
+		mutex& M;
+};
+
+//
+// Work: does the work for the vertex and returns its neighbors, recording
+// the cost for the statistics.
+//
+static vector<int> Work(WorkGraph& wg, int vertex)
 {
-	// Mutex to prevent concurrent access of visited set
-	// by multiple threads
+	vector<int> neighbors;
+	auto start = chrono::steady_clock::now();
 	{
-		lock_guard<mutex> lock(visited_mutex);
-        if (!visited.insert(vertex).second)
-            return;
+		TRACE_SCOPE("do_work");
+		neighbors = wg.do_work(vertex);
 	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	ThreadStats& stats = _stats[omp_get_thread_num()];
+	stats.busy += secs;
+	stats.vertices++;
+	if (secs > stats.maxVertex) {
+		stats.maxVertex = secs;
+		stats.maxStart = chrono::duration<double>(start - _t0).count();
+	}
+
+	if (!_measured.empty())
+		_measured[visited.index(vertex)] = (float) (secs * 1e6);
+
+	if (!_captureFile.empty()) {
+		CaptureBuffer& capture = _captured[omp_get_thread_num()];
+		capture.vertices.push_back(vertex);
+		capture.neighbors.push_back(neighbors);
+	}
+
+	return neighbors;
+}
+
+//
+// Batch: claimed vertices handed to one or more tasks, each working on a
+// span of them; the last span to finish releases the batch. Batches come
+// from a per-thread pool, so steady state allocates nothing. A batch may
+// be released by another thread than the one that acquired it, it then
+// simply joins that thread's pool.
+//
+struct Batch {
+	vector<int> vertices;
+	atomic<int> spans{0};  // spans still running
+};
+
+struct BatchPool {
+	vector<Batch*> free;
+	~BatchPool() { for (Batch* b : free) delete b; }
+};
+
+static thread_local BatchPool _pool;
+
+// The runtime may run a new task right away (e.g. when its queue is full);
+// such time is subtracted from the task-creation time:
+static thread_local bool   _spawning = false;
+static thread_local double _undeferred = 0.0;
+
+static Batch* AcquireBatch()
+{
+	if (_pool.free.empty())
+		return new Batch();
+
+	Batch* batch = _pool.free.back();
+	_pool.free.pop_back();
+	return batch;
+}
+
+static void ReleaseBatch(Batch* batch)
+{
+	batch->vertices.clear();  // keeps the capacity
+	_pool.free.push_back(batch);
+}
+
+static void RunSpan(WorkGraph& wg, Batch* batch, size_t first, size_t last, int depth);
+
+//
+// Expand: works on a claimed vertex and claims its unvisited neighbors.
+// Claiming before spawning means no task is ever created for a vertex
+// that's already visited. The neighbors become tasks of up to _batch
+// vertices each, unless there are too many tasks pending or tasks are
+// nested too deep; then they're appended to "inlined" for the caller to
+// work on.
+//
+static void Expand(WorkGraph& wg, int vertex, int depth, vector<int>& inlined)
+{
+	Batch* batch = AcquireBatch();
+	{
+		vector<int> neighbors = Work(wg, vertex);
+
+		for (int neighbor : neighbors)
+			if (Claim(neighbor))
+				batch->vertices.push_back(neighbor);
+	}
+
+	size_t n = batch->vertices.size();
+	ThreadStats& stats = _stats[omp_get_thread_num()];
+
+	if (n == 0 || (_maxDepth > 0 && depth >= _maxDepth) || _pending.load() >= _maxPending)
+	{
+		inlined.insert(inlined.end(), batch->vertices.begin(), batch->vertices.end());
+		stats.inlined += n;
+		ReleaseBatch(batch);
+		return;
+	}
+
+	auto start = chrono::steady_clock::now();
+	double undeferred = _undeferred;
+	_spawning = true;
+
+	batch->spans = (int) ((n + _batch - 1) / _batch);
+
+	for (size_t first = 0; first < n; first += _batch)
+	{
+		size_t last = std::min(n, first + _batch);
+
+		int pending = ++_pending;
+		if (pending > stats.maxPending)
+			stats.maxPending = pending;
+		stats.tasks++;
+
+		#pragma omp task firstprivate(batch, first, last, depth)
+		{
+			RunSpan(wg, batch, first, last, depth + 1);
+			_pending--;
+		}
+	}
+
+	_spawning = false;
+	stats.spawn += chrono::duration<double>(chrono::steady_clock::now() - start).count()
+	             - (_undeferred - undeferred);
+}
+
+//
+// RunSpan: the body of a task, works on vertices [first, last) of the
+// batch. Vertices inlined by a cutoff go onto an explicit stack rather
+// than being recursed into, so a long inlined chain can't overflow the
+// thread's stack; each is re-expanded, and so may spawn tasks again once
+// the pending count drops.
+//
+static void RunSpan(WorkGraph& wg, Batch* batch, size_t first, size_t last, int depth)
+{
+	if (depth > 0)  // else it's the root, run directly
+		_stats[omp_get_thread_num()].executed++;
+
+	bool undeferred = _spawning;
+	double before = _undeferred;
+	auto start = chrono::steady_clock::now();
+	_spawning = false;
+
+	Batch* inlined = AcquireBatch();
+
+	for (size_t i = first; i < last; i++)
+		Expand(wg, batch->vertices[i], depth, inlined->vertices);
+
+	while (!inlined->vertices.empty()) {
+		int vertex = inlined->vertices.back();
+		inlined->vertices.pop_back();
+		Expand(wg, vertex, depth, inlined->vertices);
+	}
+
+	ReleaseBatch(inlined);
+
+	if (--batch->spans == 0)
+		ReleaseBatch(batch);
+
+	if (undeferred) {
+		// all of it, including any undeferred tasks nested within:
+		_undeferred = before + chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		_spawning = true;
+	}
+}
+
+// Here we parallelize the BFS traversal using tasks
+// The idea is to visit all reachable vertices in parallel 
+// until we exhaust all the threads
 
-	// Do work and get the neighbors
-	vector<int> neighbors = wg.do_work(vertex);
+// Vertices are claimed (marked visited) when they're discovered, so a
+// vertex that was already visited never becomes work. Multiple threads
+// claim vertices concurrently; Claim does so with one atomic fetch_or, no lock.
+void do_work(WorkGraph& wg, int vertex) 
+{
+	if (!Claim(vertex))
+		return;
 
-	// Recursively do work for neighbors
-	for (int neighbor : neighbors) {
-        #pragma omp task
-        do_work(wg, neighbor);
-    }
+	Batch* root = AcquireBatch();
+	root->vertices.push_back(vertex);
+	root->spans = 1;
+
+	RunSpan(wg, root, 0, 1, 0);
 }
 
 //
@@ -88,26 +396,62 @@ int main(int argc, char *argv[])
 	//
 	ProcessCmdLineArgs(argc, argv);
 
+	if (_maxPending <= 0)
+		_maxPending = 8 * _numThreads;
+	if (_batch <= 0)
+		_batch = (_strategy == "actor") ? 64 : 4;
+
 	WorkGraph wg;  // NOTE: wg MUST be created in sequential code
 
 	cout << "Graph size:   " << wg.num_vertices() << " vertices" << endl;
 	cout << "Start vertex: " << wg.start_vertex() << endl;
 	cout << "# of threads: " << _numThreads << endl;
+	cout << "Strategy:     " << _strategy << endl;
 	cout << endl;
 
+	if (_profileFile.empty())
+		visited.reset(wg.num_vertices());  // room for exactly the graph's ids
+	else {
+		LoadProfile(wg);  // also sizes visited, and interns the profiled ids
+		cout << endl;
+	}
+
 	cout << "working";
 	cout.flush();
 
+	_stats.assign(_numThreads, ThreadStats());
+	_captured.assign(_captureFile.empty() ? 0 : _numThreads, CaptureBuffer());
+
   	auto start = chrono::high_resolution_clock::now();
+	_t0 = chrono::steady_clock::now();
 	
-	// Parallel block with the specified number of threads
-	#pragma omp parallel num_threads(_numThreads)
+	if (_strategy == "numa")
 	{
-		// Limit to a single thread because the
-		// traversal begins from a single starting vertex
-		#pragma omp single
+		RunNuma(wg);
+	}
+	else if (_strategy == "frontier")
+	{
+		RunFrontier(wg);
+	}
+	else if (_strategy == "actor")
+	{
+		RunActors(wg);
+	}
+	else if (_strategy == "priority")
+	{
+		RunPriority(wg);
+	}
+	else
+	{
+		// Parallel block with the specified number of threads
+		#pragma omp parallel num_threads(_numThreads)
 		{
-			do_work(wg, wg.start_vertex());
+			// Limit to a single thread because the
+			// traversal begins from a single starting vertex
+			#pragma omp single
+			{
+				do_work(wg, wg.start_vertex());
+			}
 		}
 	}
 
@@ -119,6 +463,23 @@ int main(int argc, char *argv[])
 	cout << endl;
 	cout << endl;
 
+	long numVisited = 0;
+	for (ThreadStats& s : _stats)
+		numVisited += s.vertices;
+
+	if (numVisited != wg.num_vertices())
+		cout << "**WARNING: visited " << numVisited << " of " << wg.num_vertices() << " vertices" << endl;
+
+	PrintStats(chrono::duration<double>(diff).count());
+
+	if (!_captureFile.empty())
+		WriteCapture(wg);
+
+	if (!_profileFile.empty())
+		SaveProfile(wg);
+
+	TRACE_WRITE("trace.json");
+
 	cout << endl;
 	cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
 	cout << "** Execution complete **" << endl;
@@ -128,6 +489,808 @@ int main(int argc, char *argv[])
 }
 
 
+//
+// Per-thread vertex queue for the NUMA engine. The owner pushes and pops
+// at the back (depth-first, good locality); thieves take from the front,
+// where the oldest vertices --- likely roots of bigger subgraphs --- are.
+//
+struct alignas(64) VertexQueue {
+	mutex      lock;
+	deque<int> vertices;
+};
+
+static const int LOCAL_STEAL_TRIES = 4;  // failed local steals before going remote
+
+
+//
+// RunNuma: hierarchical work-stealing traversal. Each thread is pinned to
+// its NUMA node and works on its own queue of discovered (and already
+// claimed via Claim) vertices; an idle thread steals half of a victim's
+// queue, preferring victims on its own node (see VictimSelector in numa.h).
+// The traversal is done when no vertex is queued or being worked on.
+//
+// OpenMP may start fewer threads than _numThreads, so the placement and the
+// queues are sized for the team we actually get.
+//
+static void RunNuma(WorkGraph& wg)
+{
+	NumaTopology topology;
+	NumaPlacement placement;
+
+	vector<VertexQueue*> queues;
+	_numNodes = topology.num_nodes();
+
+	atomic<long> pending(1);  // queued + in-progress vertices
+	int start = wg.start_vertex();
+	Claim(start);
+
+	#pragma omp parallel num_threads(_numThreads)
+	{
+		#pragma omp single
+		{
+			int numThreads = omp_get_num_threads();
+			placement = NumaPlacement(topology, numThreads);
+			queues.assign(numThreads, nullptr);
+			_steals.assign(numThreads, StealStats());
+		}
+
+		int me = omp_get_thread_num();
+		PinnedThread pinned(placement.cpuOf[me]);  // until the end of the region
+
+		// allocated (and first touched) after pinning => node-local memory:
+		VertexQueue* mine = new VertexQueue();
+		if (me == 0)
+			mine->vertices.push_back(start);
+		queues[me] = mine;
+
+		#pragma omp barrier
+
+		VictimSelector victims(placement, me, LOCAL_STEAL_TRIES);
+
+		while (pending.load() > 0)
+		{
+			int vertex = 0;
+			bool found = false;
+			{
+				TimedLock guard(mine->lock);
+				if (!mine->vertices.empty()) {
+					vertex = mine->vertices.back();
+					mine->vertices.pop_back();
+					found = true;
+				}
+			}
+
+			if (found) {
+				vector<int> neighbors = Work(wg, vertex);
+				vector<int> fresh;
+
+				for (int neighbor : neighbors)
+					if (Claim(neighbor))
+						fresh.push_back(neighbor);
+
+				// count the new vertices before retiring this one:
+				pending += (long) fresh.size();
+				{
+					TimedLock guard(mine->lock);
+					mine->vertices.insert(mine->vertices.end(), fresh.begin(), fresh.end());
+				}
+				pending--;
+				continue;
+			}
+
+			//
+			// out of work, steal the front half of someone else's queue:
+			//
+			bool remote;
+			int victim = victims.next(remote);
+			if (victim < 0) {  // nobody to steal from:
+				this_thread::yield();
+				continue;
+			}
+
+			vector<int> stolen;
+			{
+				TRACE_SCOPE("steal");
+				VertexQueue* theirs = queues[victim];
+				TimedLock guard(theirs->lock);
+
+				size_t take = (theirs->vertices.size() + 1) / 2;
+				stolen.assign(theirs->vertices.begin(), theirs->vertices.begin() + take);
+				theirs->vertices.erase(theirs->vertices.begin(), theirs->vertices.begin() + take);
+			}
+
+			if (!stolen.empty()) {
+				TimedLock guard(mine->lock);
+				mine->vertices.insert(mine->vertices.end(), stolen.begin(), stolen.end());
+
+				if (remote) _steals[me].remote++; else _steals[me].local++;
+				victims.success();
+			}
+			else {
+				_steals[me].failed++;
+				victims.failure(remote);
+				this_thread::yield();
+			}
+		}//while
+
+		// nobody may be looking at our queue when we free it:
+		#pragma omp barrier
+		delete mine;
+	}
+}
+
+
+//
+// Per-thread buffer of newly discovered vertices, padded so the vector
+// headers of different threads don't share a cache line:
+//
+struct alignas(64) FrontierBuffer {
+	vector<int> vertices;
+};
+
+
+//
+// RunFrontier: level-synchronous traversal. The threads share out the
+// current frontier (dynamically, vertex costs vary) and append the
+// neighbors they claim to their own buffer. Between levels the buffers
+// are concatenated into the next frontier: an exclusive prefix sum over
+// the buffer sizes gives every thread its own slice to copy into, so no
+// locks are needed. No tasks, no recursion => no deep stacks.
+//
+static void RunFrontier(WorkGraph& wg)
+{
+	vector<int> frontier, next;
+	vector<FrontierBuffer> buffers(_numThreads);
+	vector<size_t> offsets(_numThreads + 1, 0);
+
+	frontier.push_back(wg.start_vertex());
+	Claim(wg.start_vertex());
+
+	_levels = 0;
+	_maxWidth = 0;
+
+	#pragma omp parallel num_threads(_numThreads)
+	{
+		int me = omp_get_thread_num();
+		vector<int>& mine = buffers[me].vertices;
+
+		while (!frontier.empty())
+		{
+			TRACE_SCOPE("level");
+
+			mine.clear();
+
+			#pragma omp for schedule(dynamic, 1)
+			for (size_t i = 0; i < frontier.size(); i++)
+			{
+				vector<int> neighbors = Work(wg, frontier[i]);
+
+				for (int neighbor : neighbors)
+					if (Claim(neighbor))
+						mine.push_back(neighbor);
+			}
+
+			#pragma omp single
+			{
+				for (int t = 0; t < _numThreads; t++)
+					offsets[t + 1] = offsets[t] + buffers[t].vertices.size();
+
+				next.resize(offsets[_numThreads]);
+			}
+
+			copy(mine.begin(), mine.end(), next.begin() + offsets[me]);
+
+			#pragma omp barrier
+			#pragma omp single
+			{
+				_levels++;
+				_maxWidth = std::max(_maxWidth, frontier.size());
+				frontier.swap(next);
+			}
+		}//while
+	}
+}
+
+
+//
+// Message: a batch of vertices sent to their owning thread. Inboxes are
+// lock-free multi-producer / single-consumer stacks of messages: senders
+// push with a CAS on the head, the owner takes everything at once with an
+// exchange. (Messages come out newest first; order doesn't matter here.)
+//
+struct Message {
+	Message*    next;
+	vector<int> vertices;
+};
+
+struct alignas(64) Inbox {
+	atomic<Message*> head{nullptr};
+};
+
+static void Post(Inbox& inbox, Message* message)
+{
+	message->next = inbox.head.load();
+	while (!inbox.head.compare_exchange_weak(message->next, message))
+		;
+}
+
+//
+// Owner: the thread that visits the given vertex; murmur3's finalizer, so
+// ownership is balanced whatever the ids look like.
+//
+static int Owner(int vertex)
+{
+	uint32_t x = (uint32_t) vertex;
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return (int) (x % (uint32_t) _numThreads);
+}
+
+
+//
+// RunActors: owner-computes traversal. Each thread keeps its own slice of
+// the visited set, which no other thread touches, and a queue of its
+// vertices still to visit. Discovered neighbors owned by another thread
+// are batched per owner and posted to its inbox when the batch is full,
+// when this thread runs out of work, or as soon as some thread is idle.
+//
+// Quiescence: "outstanding" counts the messages posted but not yet
+// processed, plus 1 for the start vertex. A sender counts a message
+// before posting it. A receiver only subtracts the messages it processed
+// once it's idle (empty queue, nothing left to send), so the count can't
+// reach 0 while any thread still holds work. Once it is 0 with this
+// thread idle, there's no work anywhere and none can appear.
+//
+static void RunActors(WorkGraph& wg)
+{
+	vector<Inbox> inboxes(_numThreads);
+	atomic<long> outstanding(1);
+	atomic<int> idle(0);
+
+	_actors.assign(_numThreads, ActorStats());
+	int start = wg.start_vertex();
+
+	#pragma omp parallel num_threads(_numThreads)
+	{
+		int me = omp_get_thread_num();
+		ActorStats& stats = _actors[me];
+
+		unordered_set<int> mine;     // my slice of the visited set
+		vector<int> queue;           // my vertices to visit
+		vector<vector<int>> outgoing(_numThreads);
+		long consumed = 0;           // messages processed, not yet subtracted
+		bool isIdle = false;
+
+		mine.reserve(2 * wg.num_vertices() / _numThreads + 1);
+
+		if (Owner(start) == me) {
+			mine.insert(start);
+			queue.push_back(start);
+			consumed = 1;  // the start vertex counts as a message
+		}
+
+		auto send = [&](int dest) {
+			Message* message = new Message();
+			message->vertices.swap(outgoing[dest]);
+
+			outstanding++;  // counted before anyone can see it
+			Post(inboxes[dest], message);
+			stats.messages++;
+		};
+
+		auto sendAll = [&]() {
+			for (int dest = 0; dest < _numThreads; dest++)
+				if (!outgoing[dest].empty())
+					send(dest);
+		};
+
+		auto accept = [&](int vertex) {
+			if (mine.insert(vertex).second)
+				queue.push_back(vertex);
+			else
+				_stats[me].duplicates++;
+		};
+
+		for (;;)
+		{
+			//
+			// 1. take in everything posted to me:
+			//
+			Message* message = inboxes[me].head.exchange(nullptr);
+			while (message != nullptr) {
+				for (int vertex : message->vertices)
+					accept(vertex);
+
+				Message* next = message->next;
+				delete message;
+				consumed++;
+				message = next;
+			}
+
+			//
+			// 2. visit one of my vertices, routing its neighbors:
+			//
+			if (!queue.empty())
+			{
+				if (isIdle) {
+					idle--;
+					isIdle = false;
+				}
+
+				int vertex = queue.back();
+				queue.pop_back();
+
+				vector<int> neighbors = Work(wg, vertex);
+
+				for (int neighbor : neighbors)
+				{
+					int owner = Owner(neighbor);
+
+					if (owner == me) {
+						stats.local++;
+						accept(neighbor);
+					}
+					else {
+						outgoing[owner].push_back(neighbor);
+						stats.routed++;
+						if ((int) outgoing[owner].size() >= _batch)
+							send(owner);
+					}
+				}
+
+				if (idle.load() > 0)  // someone's starving, don't sit on work:
+					sendAll();
+				continue;
+			}
+
+			//
+			// 3. idle: send everything, settle my count, check for quiescence:
+			//
+			sendAll();
+
+			if (consumed > 0) {
+				outstanding -= consumed;
+				consumed = 0;
+			}
+
+			if (!isIdle) {
+				idle++;
+				isIdle = true;
+			}
+
+			if (outstanding.load() == 0)
+				break;
+
+			this_thread::yield();
+		}//for
+	}
+}
+
+
+//
+// Priorities are cost classes: bucket b holds vertices that cost about
+// 2^b microseconds. Vertices without a profiled cost go in the bucket of
+// the average profiled cost, i.e. they run before known-light vertices
+// but after known-heavy ones.
+//
+static const int NUM_BUCKETS = 32;
+static int _unknownBucket = 0;
+static long _heavy = -1;  // profiled heavy vertices, -1 => not priority
+
+static int Bucket(float us)
+{
+	int b = 0;
+	for (; us >= 2.0f && b < NUM_BUCKETS - 1; us /= 2.0f)
+		b++;
+	return b;
+}
+
+static int Priority(int vertex)
+{
+	if (_profile.empty())
+		return _unknownBucket;
+
+	float us = _profile[visited.index(vertex)];
+	return (us > 0) ? Bucket(us) : _unknownBucket;
+}
+
+//
+// Per-thread priority queue: a stack per bucket. The owner and thieves
+// both take from the highest non-empty bucket.
+//
+struct alignas(64) PriorityQueue {
+	mutex       lock;
+	vector<int> buckets[NUM_BUCKETS];
+
+	void push(int vertex)
+	{
+		buckets[Priority(vertex)].push_back(vertex);
+	}
+
+	int top()  // highest non-empty bucket, -1 if none; caller holds the lock
+	{
+		for (int b = NUM_BUCKETS - 1; b >= 0; b--)
+			if (!buckets[b].empty())
+				return b;
+		return -1;
+	}
+};
+
+
+//
+// RunPriority: cost-aware work stealing. Like RunNuma, every thread works
+// on its own queue of claimed vertices and steals when out of work, but
+// the queues are ordered by profiled cost: the owner always runs its
+// heaviest known vertex next, and a thief takes half of the victim's
+// heaviest bucket.
+//
+// Only discovered vertices are worked on: a profile may be stale (or for
+// another graph that happens to have the same size and start vertex), so
+// its ids can't be trusted to be vertices of this graph. A heavy vertex
+// (>= HEAVY x the average cost) that's discovered late therefore still
+// runs late, but ahead of everything else queued at that point. Without a
+// profile (-c) all vertices are equal and this is plain LIFO work stealing.
+//
+static const double HEAVY = 4.0;
+
+static void RunPriority(WorkGraph& wg)
+{
+	vector<PriorityQueue> queues(_numThreads);
+	atomic<long> pending(1);  // queued + in-progress vertices
+	int start = wg.start_vertex();
+
+	Claim(start);
+	queues[0].push(start);
+
+	if (!_profile.empty())
+	{
+		double sum = 0.0;
+		long known = 0;
+		for (float us : _profile)
+			if (us > 0) {
+				sum += us;
+				known++;
+			}
+		double average = (known > 0) ? sum / known : 0.0;
+		_unknownBucket = Bucket((float) average);
+
+		_heavy = 0;
+		for (float us : _profile)
+			if (known > 0 && us >= HEAVY * average)
+				_heavy++;
+	}
+
+	#pragma omp parallel num_threads(_numThreads)
+	{
+		int me = omp_get_thread_num();
+		PriorityQueue& mine = queues[me];
+		minstd_rand rng(me + 1);
+
+		while (pending.load() > 0)
+		{
+			int vertex = 0;
+			bool found = false;
+			{
+				TimedLock guard(mine.lock);
+				int b = mine.top();
+				if (b >= 0) {
+					vertex = mine.buckets[b].back();
+					mine.buckets[b].pop_back();
+					found = true;
+				}
+			}
+
+			if (found) {
+				vector<int> neighbors = Work(wg, vertex);
+				vector<int> fresh;
+
+				for (int neighbor : neighbors)
+					if (Claim(neighbor))
+						fresh.push_back(neighbor);
+
+				// count the new vertices before retiring this one:
+				pending += (long) fresh.size();
+				{
+					TimedLock guard(mine.lock);
+					for (int v : fresh)
+						mine.push(v);
+				}
+				pending--;
+				continue;
+			}
+
+			//
+			// out of work, steal from the heaviest bucket of a random victim:
+			//
+			if (_numThreads == 1) {
+				this_thread::yield();
+				continue;
+			}
+
+			int victim = (me + 1 + rng() % (_numThreads - 1)) % _numThreads;
+			vector<int> stolen;
+			{
+				TRACE_SCOPE("steal");
+				PriorityQueue& theirs = queues[victim];
+				TimedLock guard(theirs.lock);
+
+				int b = theirs.top();
+				if (b >= 0) {
+					vector<int>& bucket = theirs.buckets[b];
+					size_t take = (bucket.size() + 1) / 2;
+
+					// the oldest (bottom) half, the owner keeps its newest:
+					stolen.assign(bucket.begin(), bucket.begin() + take);
+					bucket.erase(bucket.begin(), bucket.begin() + take);
+				}
+			}
+
+			if (!stolen.empty()) {
+				TimedLock guard(mine.lock);
+				for (int v : stolen)
+					mine.push(v);
+			}
+			else
+				this_thread::yield();
+		}//while
+	}
+}
+
+
+//
+// PrintStats: one line of per-thread load statistics, in key=value form
+// so bench.sh can parse it. The ideal makespan is bounded below by both
+// busy_sum / threads and the single most expensive vertex (task_max).
+//
+static void PrintStats(double wall)
+{
+	double sum = 0.0, max = 0.0, min = 1e300, taskMax = 0.0, taskMaxStart = 0.0;
+
+	for (ThreadStats& s : _stats) {
+		sum += s.busy;
+		if (s.busy > max) max = s.busy;
+		if (s.busy < min) min = s.busy;
+		if (s.maxVertex > taskMax) {
+			taskMax = s.maxVertex;
+			taskMaxStart = s.maxStart;
+		}
+	}
+
+	cout << "** Stats: threads=" << _numThreads
+	     << " wall=" << wall
+	     << " busy_sum=" << sum
+	     << " busy_max=" << max
+	     << " busy_min=" << min
+	     << " task_max=" << taskMax
+	     << " task_max_start=" << taskMaxStart << endl;
+
+	if (!_steals.empty())
+		PrintStealStats(_steals, _numNodes);
+
+	if (_heavy >= 0)
+		cout << "** Priority: heavy_known=" << _heavy << endl;
+
+	if (_levels > 0)
+		cout << "** Frontier: levels=" << _levels << " max_width=" << _maxWidth << endl;
+
+	if (!_actors.empty())
+	{
+		long messages = 0, routed = 0, local = 0;
+
+		for (ActorStats& s : _actors) {
+			messages += s.messages;
+			routed += s.routed;
+			local += s.local;
+		}
+
+		cout << "** Actor: messages=" << messages
+		     << " routed=" << routed
+		     << " vertices_per_msg=" << ((messages > 0) ? (double) routed / messages : 0.0)
+		     << " local_pct=" << ((local + routed > 0) ? 100.0 * local / (local + routed) : 0.0) << endl;
+	}
+
+	if (_strategy == "tasks")
+	{
+		long tasks = 0, executed = 0, inlined = 0;
+		int maxPending = 0;
+		double spawn = 0.0;
+
+		for (ThreadStats& s : _stats) {
+			tasks += s.tasks;
+			executed += s.executed;
+			inlined += s.inlined;
+			spawn += s.spawn;
+			if (s.maxPending > maxPending) maxPending = s.maxPending;
+		}
+
+		// share of the threads' time not spent in do_work (idle + overhead):
+		double nonbusy = (wall > 0) ? 100.0 * (1.0 - sum / (wall * _numThreads)) : 0.0;
+
+		cout << "** Tasks: created=" << tasks
+		     << " executed=" << executed
+		     << " inlined=" << inlined
+		     << " max_pending=" << maxPending
+		     << " spawn_secs=" << spawn
+		     << " nonbusy_pct=" << nonbusy << endl;
+	}
+
+	PrintContention(wall);
+}
+
+
+//
+// PrintContention: where the threads' time went. Each thread's share of
+// the wall time is split into do_work (busy), waiting for contended queue
+// locks, creating tasks, and everything else (idle, stealing, runtime
+// overhead); "limit" names the largest, i.e. what to optimize first.
+//
+static void PrintContention(double wall)
+{
+	double busy = 0.0, lockWait = 0.0, spawn = 0.0;
+	long duplicates = 0, locks = 0, contended = 0;
+
+	if (_verbose)
+	{
+		cout << endl;
+		cout << setw(7) << "thread" << setw(9) << "vertices" << setw(10) << "busy"
+		     << setw(10) << "idle" << setw(9) << "created" << setw(9) << "executed"
+		     << setw(11) << "duplicates" << setw(11) << "lock_wait" << setw(10) << "contended" << endl;
+	}
+
+	for (int t = 0; t < _numThreads; t++)
+	{
+		ThreadStats& s = _stats[t];
+
+		busy += s.busy;
+		lockWait += s.lockWait;
+		spawn += s.spawn;
+		duplicates += s.duplicates;
+		locks += s.locks;
+		contended += s.contended;
+
+		if (_verbose)
+			cout << setw(7) << t << setw(9) << s.vertices << setw(10) << setprecision(4) << s.busy
+			     << setw(10) << wall - s.busy - s.lockWait - s.spawn << setw(9) << s.tasks
+			     << setw(9) << s.executed << setw(11) << s.duplicates << setw(11) << s.lockWait
+			     << setw(10) << s.contended << endl;
+	}
+
+	if (_verbose)
+	{
+		cout << setprecision(6);
+		cout << endl;
+	}
+
+	double total = wall * _numThreads;
+	double other = total - busy - lockWait - spawn;
+	if (total <= 0)
+		total = 1.0;
+
+	const char* limit = "do_work";
+	double most = busy;
+	if (other > most) { limit = "idle"; most = other; }
+	if (lockWait > most) { limit = "locks"; most = lockWait; }
+	if (spawn > most) { limit = "tasks"; most = spawn; }
+
+	cout << "** Contention: busy_pct=" << 100.0 * busy / total
+	     << " lock_pct=" << 100.0 * lockWait / total
+	     << " spawn_pct=" << 100.0 * spawn / total
+	     << " idle_pct=" << 100.0 * other / total
+	     << " limit=" << limit
+	     << " duplicates=" << duplicates
+	     << " locks=" << locks
+	     << " contended=" << contended << endl;
+}
+
+
+//
+// WriteCapture: merges the threads' records of the discovered edges and
+// writes them to the capture file as CSR.
+//
+static void WriteCapture(WorkGraph& wg)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	vector<int> vertices;
+	vector<const vector<int>*> neighbors;
+	size_t edges = 0;
+
+	for (CaptureBuffer& capture : _captured)
+		for (size_t i = 0; i < capture.vertices.size(); i++) {
+			vertices.push_back(capture.vertices[i]);
+			neighbors.push_back(&capture.neighbors[i]);
+			edges += capture.neighbors[i].size();
+		}
+
+	if (!WriteCsr(_captureFile, wg.start_vertex(), vertices, neighbors))
+		return;
+
+	auto stop = chrono::high_resolution_clock::now();
+
+	cout << "** Captured " << vertices.size() << " vertices, " << edges << " edges to '"
+	     << _captureFile << "' in " << chrono::duration<double>(stop - start).count() << " secs" << endl;
+}
+
+
+//
+// LoadProfile: reads the cost profile (if any) into _profile, by dense
+// index; also sets up _measured so this run's costs get recorded.
+//
+// The profiled ids are interned before the traversal, and nothing says
+// they're all vertices of this graph (the profile may be stale), so
+// visited is sized for the graph's ids plus the profile's: interning never
+// runs out of room. Records with a bogus cost, or beyond that room, are
+// skipped.
+//
+static void LoadProfile(WorkGraph& wg)
+{
+	vector<CostRecord> records;
+	bool found = LoadCostProfile(_profileFile, wg.num_vertices(), wg.start_vertex(), records);
+
+	size_t room = records.size();  // for profiled ids, on top of the graph's
+	size_t capacity = wg.num_vertices() + room;
+
+	visited.reset(capacity);
+	_profile.assign(capacity, 0.0f);
+	_measured.assign(capacity, 0.0f);
+
+	if (!found)
+	{
+		FILE* f = fopen(_profileFile.c_str(), "rb");
+		if (f != nullptr) {
+			fclose(f);
+			cout << "**WARNING: cost profile '" << _profileFile << "' is for another graph, ignored" << endl;
+			cout << "  (the prebuilt workgraph.o makes a new random graph each run, use make synth)" << endl;
+		}
+
+		cout << "Cost profile: none for this graph in '" << _profileFile << "', starting one" << endl;
+		return;
+	}
+
+	size_t loaded = 0, skipped = 0;
+
+	for (CostRecord& r : records)
+	{
+		if (!(r.us > 0.0f && r.us < 1e30f) || visited.ids().size() >= room) {
+			skipped++;
+			continue;
+		}
+
+		_profile[visited.index(r.vertex)] = r.us;
+		loaded++;
+	}
+
+	cout << "Cost profile: " << loaded << " vertices";
+	if (skipped > 0)
+		cout << " (" << skipped << " bad records skipped)";
+	cout << endl;
+}
+
+
+//
+// SaveProfile: rewrites the profile with the costs measured by this run.
+// Profiled ids this run didn't visit are dropped, so those of a stale
+// profile don't outlive it.
+//
+static void SaveProfile(WorkGraph& wg)
+{
+	const DenseIds& ids = visited.ids();
+	vector<CostRecord> records;
+
+	for (uint32_t i = 0; i < ids.size(); i++)
+	{
+		if (_measured[i] > 0)
+			records.push_back(CostRecord{ ids.id(i), _measured[i] });
+	}
+
+	if (SaveCostProfile(_profileFile, wg.num_vertices(), wg.start_vertex(), records))
+		cout << "** Cost profile: " << records.size() << " vertices saved to '" << _profileFile << "'" << endl;
+}
+
+
 //
 // processCmdLineArgs:
 //
@@ -138,7 +1301,7 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-s Strategy] [-b Batch] [-p MaxPending] [-d MaxDepth] [-w CaptureFile] [-c CostProfile] [-v]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
@@ -146,10 +1309,51 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-b") == 0) && (i+1 < argc))  // vertices per task / message:
+		{
+			i++;
+			_batch = std::max(1, atoi(argv[i]));
+		}
+		else if ((strcmp(argv[i], "-p") == 0) && (i+1 < argc))  // pending-task cutoff:
+		{
+			i++;
+			_maxPending = atoi(argv[i]);
+		}
+		else if ((strcmp(argv[i], "-d") == 0) && (i+1 < argc))  // nesting-depth cutoff:
+		{
+			i++;
+			_maxDepth = atoi(argv[i]);
+		}
+		else if ((strcmp(argv[i], "-w") == 0) && (i+1 < argc))  // capture file:
+		{
+			i++;
+			_captureFile = argv[i];
+		}
+		else if ((strcmp(argv[i], "-c") == 0) && (i+1 < argc))  // cost profile:
+		{
+			i++;
+			_profileFile = argv[i];
+		}
+		else if (strcmp(argv[i], "-v") == 0)  // per-thread report:
+		{
+			_verbose = true;
+		}
+		else if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc))  // traversal strategy:
+		{
+			i++;
+			_strategy = argv[i];
+			if (_strategy != "tasks" && _strategy != "numa" && _strategy != "frontier" &&
+			    _strategy != "actor" && _strategy != "priority")
+			{
+				cout << "**Unknown strategy: '" << argv[i] << "'" << endl;
+				cout << "**Strategies: tasks, numa, frontier, actor, priority" << endl << endl;
+				exit(0);
+			}
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-s Strategy] [-b Batch] [-p MaxPending] [-d MaxDepth] [-w CaptureFile] [-c CostProfile] [-v]" << endl << endl;
 			exit(0);
 		}
 
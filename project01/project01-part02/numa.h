@@ -0,0 +1,274 @@
+/*numa.h*/
+
+//
+// NUMA topology discovery and helpers for hierarchical work stealing.
+//
+// Threads are grouped per NUMA node (discovered from /sys/devices/system/node)
+// and pinned to their node's cpus for the duration of a parallel region (see
+// PinnedThread). When a thread runs out of work it steals
+// from random threads on its own node first, and only crosses to another
+// node after a number of consecutive failed local attempts --- which keeps
+// cache lines and pages on the local socket as long as there is local work.
+//
+// Per-thread queues should be allocated by the owning thread *after* it has
+// been pinned: Linux places a page on the node of the thread that first
+// touches it, so such queues end up in node-local memory.
+//
+// For testing on a single-socket machine, NUMA_NODES=k in the environment
+// splits the cpus into k fake nodes.
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+
+//
+// ParseCpuList: parses a sysfs cpu list such as "0-3,8-11".
+//
+inline std::vector<int> ParseCpuList(const std::string& list)
+{
+  std::vector<int> cpus;
+  size_t pos = 0;
+
+  while (pos < list.size())
+  {
+    size_t comma = list.find(',', pos);
+    if (comma == std::string::npos)
+      comma = list.size();
+
+    std::string range = list.substr(pos, comma - pos);
+    size_t dash = range.find('-');
+
+    if (!range.empty() && range[0] != '\n') {
+      int first = atoi(range.c_str());
+      int last = (dash == std::string::npos) ? first : atoi(range.c_str() + dash + 1);
+      for (int cpu = first; cpu <= last; cpu++)
+        cpus.push_back(cpu);
+    }
+
+    pos = comma + 1;
+  }
+
+  return cpus;
+}
+
+
+//
+// NumaTopology: the cpus of each NUMA node (memory-only nodes are skipped).
+//
+struct NumaTopology {
+  std::vector<std::vector<int>> nodes;
+
+  NumaTopology()
+  {
+    for (int n = 0; ; n++)
+    {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+      if (!file.is_open())
+        break;
+
+      std::string list;
+      std::getline(file, list);
+
+      std::vector<int> cpus = ParseCpuList(list);
+      if (!cpus.empty())
+        nodes.push_back(cpus);
+    }
+
+    if (nodes.empty()) {  // no sysfs info, assume one node:
+      nodes.push_back(std::vector<int>());
+      for (int cpu = 0; cpu < get_nprocs(); cpu++)
+        nodes[0].push_back(cpu);
+    }
+
+    const char* fake = getenv("NUMA_NODES");
+    if (fake != nullptr && atoi(fake) > 1)
+      split(atoi(fake));
+  }
+
+  int num_nodes() const { return (int) nodes.size(); }
+
+  private:
+    // split: regroups all cpus into k (fake) nodes of consecutive cpus.
+    void split(int k)
+    {
+      std::vector<int> all;
+      for (auto& node : nodes)
+        all.insert(all.end(), node.begin(), node.end());
+
+      nodes.assign(k, std::vector<int>());
+      for (size_t i = 0; i < all.size(); i++)
+        nodes[i * k / all.size()].push_back(all[i]);
+
+      for (auto& node : nodes)  // more fake nodes than cpus:
+        if (node.empty())
+          node.push_back(all[0]);
+    }
+};
+
+
+//
+// NumaPlacement: spreads T threads over the nodes in contiguous blocks
+// (thread t lives on node t * nodes / T), each pinned to one of its node's
+// cpus round-robin.
+//
+struct NumaPlacement {
+  std::vector<int> nodeOf;                  // thread => node
+  std::vector<int> cpuOf;                   // thread => cpu
+  std::vector<std::vector<int>> threadsOn;  // node => threads
+
+  NumaPlacement() {}
+
+  NumaPlacement(const NumaTopology& topo, int numThreads)
+  {
+    int numNodes = topo.num_nodes();
+
+    nodeOf.resize(numThreads);
+    cpuOf.resize(numThreads);
+    threadsOn.assign(numNodes, std::vector<int>());
+
+    for (int t = 0; t < numThreads; t++) {
+      int node = (int) ((long) t * numNodes / numThreads);
+      const std::vector<int>& cpus = topo.nodes[node];
+
+      nodeOf[t] = node;
+      cpuOf[t] = cpus[threadsOn[node].size() % cpus.size()];
+      threadsOn[node].push_back(t);
+    }
+  }
+};
+
+
+//
+// PinnedThread: binds the calling thread to the given cpu, and restores the
+// affinity it had when destroyed --- OpenMP reuses its threads, and later
+// parallel regions shouldn't inherit the pinning. If the OS refuses (e.g.
+// the cpu isn't in our cpuset), a warning is printed and the thread simply
+// runs unpinned.
+//
+class PinnedThread {
+  public:
+    explicit PinnedThread(int cpu)
+      : Restore(false)
+    {
+      bool saved = (pthread_getaffinity_np(pthread_self(), sizeof(Previous), &Previous) == 0);
+
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (err != 0) {
+        std::cerr << ("**WARNING: unable to pin a thread to cpu " + std::to_string(cpu)
+                      + ": " + strerror(err) + "\n");
+        return;
+      }
+
+      Restore = saved;
+    }
+
+    ~PinnedThread()
+    {
+      if (Restore)
+        pthread_setaffinity_np(pthread_self(), sizeof(Previous), &Previous);
+    }
+
+    PinnedThread(const PinnedThread&) = delete;
+    PinnedThread& operator=(const PinnedThread&) = delete;
+
+  private:
+    cpu_set_t Previous;
+    bool      Restore;
+};
+
+
+//
+// StealStats: per-thread steal counters, padded to a cache line.
+//
+struct alignas(64) StealStats {
+  long local = 0;    // successful steals from the same node
+  long remote = 0;   // successful steals from another node
+  long failed = 0;   // attempts that found the victim empty
+};
+
+
+//
+// VictimSelector: picks whom thread "self" should steal from next. Victims
+// are random threads on the same node until localTries consecutive steals
+// have failed; then a random thread on another node is tried. A success,
+// or a failed remote attempt, resets the count.
+//
+class VictimSelector {
+  public:
+    VictimSelector(const NumaPlacement& placement, int self, int localTries)
+      : LocalTries(localTries), Failures(0), Rng(self + 1)
+    {
+      int node = placement.nodeOf[self];
+
+      for (int t : placement.threadsOn[node])
+        if (t != self)
+          Local.push_back(t);
+
+      for (int n = 0; n < (int) placement.threadsOn.size(); n++)
+        if (n != node)
+          for (int t : placement.threadsOn[n])
+            Remote.push_back(t);
+    }
+
+    //
+    // next: returns the victim, or -1 if there's nobody to steal from; sets
+    // remote if the victim is on another node.
+    //
+    int next(bool& remote)
+    {
+      remote = Local.empty() || (Failures >= LocalTries && !Remote.empty());
+
+      std::vector<int>& pool = remote ? Remote : Local;
+      if (pool.empty())
+        return -1;
+
+      return pool[Rng() % pool.size()];
+    }
+
+    void success() { Failures = 0; }
+    void failure(bool remote) { Failures = remote ? 0 : Failures + 1; }
+
+  private:
+    int LocalTries;
+    int Failures;
+    std::minstd_rand Rng;
+    std::vector<int> Local, Remote;
+};
+
+
+//
+// PrintStealStats: totals of the per-thread steal counters, in key=value
+// form; remote_pct is the share of successful steals that crossed nodes.
+//
+inline void PrintStealStats(const std::vector<StealStats>& stats, int numNodes)
+{
+  long local = 0, remote = 0, failed = 0;
+
+  for (const StealStats& s : stats) {
+    local += s.local;
+    remote += s.remote;
+    failed += s.failed;
+  }
+
+  double pct = (local + remote > 0) ? 100.0 * remote / (local + remote) : 0.0;
+
+  std::cout << "** NUMA: nodes=" << numNodes
+            << " local_steals=" << local
+            << " remote_steals=" << remote
+            << " failed_steals=" << failed
+            << " remote_pct=" << pct << std::endl;
+}
@@ -0,0 +1,169 @@
+/*visitedbench.cpp*/
+
+//
+// Contention microbenchmark for the visited set: the mutex-protected
+// std::unordered_set<int> the traversal used to have vs. the concurrent
+// VisitedSet (visitedset.h), presized and grown from scratch, and the
+// DenseVisited bitmap over interned ids (denseids.h).
+//
+// Every id is offered R times, spread over the threads in random order,
+// much like a traversal that discovers a vertex from several neighbors.
+// Each run checks that exactly N inserts succeeded.
+//
+// Usage:
+//   visitedbench [-?] [-n NumIds] [-r Repeats] [-t MaxThreads]
+//
+// Build with "make visitedbench".
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <mutex>
+#include <sys/sysinfo.h>
+#include <omp.h>
+
+#include "visitedset.h"
+#include "denseids.h"
+
+using namespace std;
+
+
+//
+// Globals:
+//
+static int _numIds = 1000000;
+static int _repeats = 4;
+static int _maxThreads = 1;
+
+static void ProcessCmdLineArgs(int argc, char* argv[]);
+
+
+//
+// Run: offers all the ids to tryVisit using T threads; returns the time in
+// secs, and the # of successful visits in "visits".
+//
+static double Run(const vector<int>& ids, int T, const function<bool(int)>& tryVisit, long& visits)
+{
+  long count = 0;
+
+  auto start = chrono::high_resolution_clock::now();
+
+  #pragma omp parallel for num_threads(T) schedule(static) reduction(+:count)
+  for (size_t i = 0; i < ids.size(); i++)
+    if (tryVisit(ids[i]))
+      count++;
+
+  auto stop = chrono::high_resolution_clock::now();
+
+  visits = count;
+  return chrono::duration<double>(stop - start).count();
+}
+
+
+int main(int argc, char* argv[])
+{
+  cout << "** Visited Set Benchmark **" << endl;
+  cout << endl;
+
+  _maxThreads = get_nprocs();
+  ProcessCmdLineArgs(argc, argv);
+
+  //
+  // N unique random ids, each repeated R times, in random order:
+  //
+  mt19937 rng(1);
+  uniform_int_distribution<int> anyId(INT32_MIN, INT32_MAX);
+  unordered_set<int> unique;
+  vector<int> ids;
+
+  while ((int) unique.size() < _numIds)
+    unique.insert(anyId(rng));
+
+  for (int r = 0; r < _repeats; r++)
+    ids.insert(ids.end(), unique.begin(), unique.end());
+
+  shuffle(ids.begin(), ids.end(), rng);
+
+  cout << "# of ids:     " << _numIds << " x " << _repeats << endl;
+  cout << "Max threads:  " << _maxThreads << endl;
+  cout << endl;
+
+  cout << setw(8) << "threads" << setw(20) << "mutex+unordered_set"
+       << setw(20) << "VisitedSet" << setw(20) << "VisitedSet(grow)"
+       << setw(20) << "DenseVisited" << "   (M ids/sec)" << endl;
+
+  for (int T = 1; ; T = min(2 * T, _maxThreads))
+  {
+    double secs[4];
+    long visits[4];
+
+    {
+      mutex m;
+      unordered_set<int> visited;
+      secs[0] = Run(ids, T, [&](int v) {
+        lock_guard<mutex> lock(m);
+        return visited.insert(v).second;
+      }, visits[0]);
+    }
+    {
+      VisitedSet visited(_numIds);
+      secs[1] = Run(ids, T, [&](int v) { return visited.try_visit(v); }, visits[1]);
+    }
+    {
+      VisitedSet visited;
+      secs[2] = Run(ids, T, [&](int v) { return visited.try_visit(v); }, visits[2]);
+    }
+    {
+      DenseVisited visited(_numIds);
+      secs[3] = Run(ids, T, [&](int v) { return visited.try_visit(v); }, visits[3]);
+    }
+
+    cout << setw(8) << T;
+    for (int k = 0; k < 4; k++) {
+      if (visits[k] != _numIds) {
+        cout << endl << "**ERROR: " << visits[k] << " visits, expected " << _numIds << endl;
+        return 1;
+      }
+      cout << setw(20) << fixed << setprecision(2) << ids.size() / secs[k] / 1e6;
+    }
+    cout << endl;
+
+    if (T == _maxThreads)
+      break;
+  }
+
+  cout << endl;
+  cout << "** Done!" << endl;
+
+  return 0;
+}
+
+
+//
+// processCmdLineArgs:
+//
+static void ProcessCmdLineArgs(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      _numIds = max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      _repeats = max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      _maxThreads = max(1, atoi(argv[++i]));
+    else
+    {
+      cout << "**Usage: visitedbench [-?] [-n NumIds] [-r Repeats] [-t MaxThreads]" << endl << endl;
+      exit(0);
+    }
+  }
+}
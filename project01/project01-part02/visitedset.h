@@ -0,0 +1,221 @@
+/*visitedset.h*/
+
+//
+// Concurrent "visited" set of vertex ids for the WorkGraph traversal, a
+// replacement for a mutex-protected std::unordered_set<int>.
+//
+// The set is an open-addressing (linear probing) hash table of 64-bit
+// slots, split into SHARDS independent shards by the top bits of the hash.
+// A vertex is claimed with a single CAS on its slot, so concurrent inserts
+// never block each other. Each shard grows on its own (doubling at 50%
+// load): inserts hold the shard's resize lock *shared*, so they run in
+// parallel, and only the rare resize of that one shard takes it exclusive.
+// Presize with the expected # of vertices (see reset) and growth never
+// happens at all.
+//
+// Ids are arbitrary 32-bit ints; a slot holds the id in its low 32 bits
+// plus a "used" bit above them, so every id (0 and negatives included) can
+// be stored and an all-zero slot means empty.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+class VisitedSet {
+  public:
+    explicit VisitedSet(size_t expected = 1024)
+    {
+      init(expected);
+    }
+
+    ~VisitedSet()
+    {
+      for (Shard& s : Shards)
+        delete[] s.slots;
+    }
+
+    VisitedSet(const VisitedSet&) = delete;
+    VisitedSet& operator=(const VisitedSet&) = delete;
+
+    //
+    // try_visit: marks the vertex as visited; returns true if this call did
+    // so, false if it was already visited. Safe to call from any thread.
+    //
+    bool try_visit(int vertex)
+    {
+      uint32_t h = hash((uint32_t) vertex);
+      uint64_t key = USED | (uint32_t) vertex;
+      Shard& s = Shards[h >> (32 - SHARD_BITS)];
+
+      for (;;)
+      {
+        bool inserted = false;
+        {
+          std::shared_lock<std::shared_mutex> guard(s.resize);
+
+          int result = insert(s.slots, s.mask, key, h);
+          if (result == PRESENT)
+            return false;
+
+          if (result == INSERTED) {
+            if ((s.count.fetch_add(1) + 1) * 2 <= s.mask + 1)
+              return true;
+            inserted = true;  // but the shard is now over 50% load
+          }
+        }
+
+        grow(s);
+
+        if (inserted)
+          return true;
+        // else the shard was full, retry in the bigger one
+      }
+    }
+
+    //
+    // contains: true if the vertex has been visited.
+    //
+    bool contains(int vertex)
+    {
+      uint32_t h = hash((uint32_t) vertex);
+      uint64_t key = USED | (uint32_t) vertex;
+      Shard& s = Shards[h >> (32 - SHARD_BITS)];
+
+      std::shared_lock<std::shared_mutex> guard(s.resize);
+
+      for (size_t i = h & s.mask, n = 0; n <= s.mask; i = (i + 1) & s.mask, n++) {
+        uint64_t slot = s.slots[i].load(std::memory_order_acquire);
+        if (slot == key)
+          return true;
+        if (slot == 0)
+          return false;
+      }
+
+      return false;
+    }
+
+    //
+    // size: # of visited vertices (exact once the inserting threads are done).
+    //
+    size_t size() const
+    {
+      size_t total = 0;
+      for (const Shard& s : Shards)
+        total += s.count.load();
+      return total;
+    }
+
+    //
+    // reset: empties the set and presizes it for the expected # of vertices.
+    // NOT thread-safe, call between traversals.
+    //
+    void reset(size_t expected)
+    {
+      for (Shard& s : Shards)
+        delete[] s.slots;
+      init(expected);
+    }
+
+  private:
+    static const int SHARD_BITS = 6;
+    static const int SHARDS = 1 << SHARD_BITS;
+    static const size_t MIN_SLOTS = 16;
+    static constexpr uint64_t USED = 1ull << 32;
+
+    enum { INSERTED, PRESENT, FULL };
+
+    struct alignas(64) Shard {
+      std::shared_mutex resize;            // shared: insert, exclusive: grow
+      std::atomic<uint64_t>* slots = nullptr;
+      size_t mask = 0;                     // # of slots - 1
+      std::atomic<size_t> count{0};
+    };
+
+    Shard Shards[SHARDS];
+
+    // hash: murmur3's finalizer, spreads sequential ids too.
+    static uint32_t hash(uint32_t x)
+    {
+      x ^= x >> 16;
+      x *= 0x85ebca6b;
+      x ^= x >> 13;
+      x *= 0xc2b2ae35;
+      x ^= x >> 16;
+      return x;
+    }
+
+    static std::atomic<uint64_t>* allocate(size_t n)
+    {
+      std::atomic<uint64_t>* slots = new std::atomic<uint64_t>[n];
+      for (size_t i = 0; i < n; i++)
+        slots[i].store(0, std::memory_order_relaxed);
+      return slots;
+    }
+
+    void init(size_t expected)
+    {
+      // 2 slots per expected vertex, i.e. at most 50% load:
+      size_t n = MIN_SLOTS;
+      while (n < 2 * expected / SHARDS + 1)
+        n *= 2;
+
+      for (Shard& s : Shards) {
+        s.slots = allocate(n);
+        s.mask = n - 1;
+        s.count.store(0);
+      }
+    }
+
+    //
+    // insert: claims an empty slot for key along its probe sequence via CAS.
+    //
+    static int insert(std::atomic<uint64_t>* slots, size_t mask, uint64_t key, uint32_t h)
+    {
+      for (size_t i = h & mask, n = 0; n <= mask; i = (i + 1) & mask, n++)
+      {
+        uint64_t slot = slots[i].load(std::memory_order_acquire);
+
+        if (slot == 0) {
+          if (slots[i].compare_exchange_strong(slot, key, std::memory_order_acq_rel))
+            return INSERTED;
+          // lost the race; slot now holds whatever the winner wrote:
+        }
+
+        if (slot == key)
+          return PRESENT;
+      }
+
+      return FULL;
+    }
+
+    //
+    // grow: doubles the shard (if it's still over 50% load) and
+    // rehashes its keys; inserts into this shard wait meanwhile.
+    //
+    void grow(Shard& s)
+    {
+      std::unique_lock<std::shared_mutex> guard(s.resize);
+
+      size_t n = s.mask + 1;
+      if (s.count.load() * 2 <= n)
+        return;  // someone else grew it already
+
+      size_t bigger = 2 * n;
+      std::atomic<uint64_t>* slots = allocate(bigger);
+
+      for (size_t i = 0; i < n; i++) {
+        uint64_t key = s.slots[i].load(std::memory_order_relaxed);
+        if (key != 0)
+          insert(slots, bigger - 1, key, hash((uint32_t) key));
+      }
+
+      delete[] s.slots;
+      s.slots = slots;
+      s.mask = bigger - 1;
+    }
+};
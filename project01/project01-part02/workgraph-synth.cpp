@@ -0,0 +1,254 @@
+/*workgraph-synth.cpp*/
+
+//
+// Synthetic, source-level stand-in for the prebuilt workgraph-*.o. The
+// graph and vertex costs are generated from a seed when the graph is
+// created, so runs are reproducible. Like the original, vertices are
+// identified by random (unpredictable) integers, the graph is directed,
+// may have self-loops but no multi-edges, and every vertex is reachable
+// from the start vertex. Build with "make synth".
+//
+// Since the WorkGraph interface only has a default constructor, the
+// workload is configured via environment variables:
+//
+//   WG_VERTICES  # of vertices                              (default 10000)
+//   WG_SHAPE     wide | deep                                (default wide)
+//   WG_DEGREE    uniform | powerlaw                         (default uniform)
+//   WG_AVG_DEG   average out-degree                         (default 4)
+//   WG_DIST      uniform | heavy | hotspot  (vertex costs)  (default uniform)
+//   WG_MEAN_US   mean cost per vertex, in microseconds      (default 1000)
+//   WG_SEED      random seed                                (default 1)
+//   WG_WORK      spin | sleep                               (default spin)
+//
+// Shapes: reachability comes from a spanning tree; "wide" attaches each
+// vertex to a random earlier vertex (shallow, bushy), "deep" to the
+// previous vertex (one long path). Extra edges are then added to random
+// vertices, with out-degrees drawn uniformly or from a power law (a few
+// hub vertices with very many neighbors). Cost distributions are as in
+// workmatrix-synth.cpp; "hotspot" makes runs of consecutively generated
+// vertices (i.e. neighborhoods of the spanning tree) expensive.
+//
+// NOTE: WorkGraph declares no data members (it must stay layout-compatible
+// with the prebuilt objects), so the graph lives in this file.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "workgraph.h"
+
+using namespace std;
+
+
+//
+// Globals:
+//
+static bool                     _sleep = false;
+static vector<int>              _ids;        // vertex index => id
+static unordered_map<int, int>  _index;      // vertex id => index
+static vector<vector<int>>      _adj;        // neighbor ids, by index
+static vector<double>           _costs;      // microseconds, by index
+static int                      _refs = 0;
+
+
+static int env_int(const char* name, int def)
+{
+  const char* v = getenv(name);
+  return (v != nullptr) ? atoi(v) : def;
+}
+
+static string env_str(const char* name, const char* def)
+{
+  const char* v = getenv(name);
+  return (v != nullptr) ? string(v) : string(def);
+}
+
+
+//
+// generate_costs: per-vertex costs with the given mean.
+//
+static void generate_costs(int n, mt19937_64& rng)
+{
+  string dist = env_str("WG_DIST", "uniform");
+  double mean = env_int("WG_MEAN_US", 1000);
+
+  _costs.assign(n, 0.0);
+
+  if (dist == "heavy")
+  {
+    double alpha = 1.5;
+    double xm = mean * (alpha - 1) / alpha;
+    uniform_real_distribution<double> u(0.0, 1.0);
+
+    for (auto& c : _costs)
+      c = min(xm / pow(1.0 - u(rng), 1.0 / alpha), 1000.0 * mean);
+  }
+  else if (dist == "hotspot")
+  {
+    // 4 runs of n/40 consecutive vertices that cost 50x the base cost:
+    int K = 4;
+    int len = max(1, n / 40);
+    uniform_int_distribution<int> pos(0, n - 1);
+    double total = 0.0;
+
+    for (auto& c : _costs)
+      c = 1.0;
+    for (int k = 0; k < K; k++) {
+      int start = pos(rng);
+      for (int v = start; v < min(n, start + len); v++)
+        _costs[v] = 50.0;
+    }
+    for (auto c : _costs)
+      total += c;
+
+    double scale = mean * n / total;
+    for (auto& c : _costs)
+      c *= scale;
+  }
+  else  // uniform:
+  {
+    if (dist != "uniform")
+      cout << "**Unknown WG_DIST '" << dist << "', using uniform" << endl;
+
+    uniform_real_distribution<double> u(0.0, 2.0 * mean);
+    for (auto& c : _costs)
+      c = u(rng);
+  }
+}
+
+
+//
+// generate: builds the graph according to the environment.
+//
+static void generate()
+{
+  int n = max(1, env_int("WG_VERTICES", 10000));
+  bool deep = (env_str("WG_SHAPE", "wide") == "deep");
+  bool powerlaw = (env_str("WG_DEGREE", "uniform") == "powerlaw");
+  int avgDegree = max(1, env_int("WG_AVG_DEG", 4));
+
+  _sleep = (env_str("WG_WORK", "spin") == "sleep");
+
+  mt19937_64 rng(env_int("WG_SEED", 1));
+
+  //
+  // unique random ids:
+  //
+  uniform_int_distribution<int> anyId(1, 2000000000);
+
+  _ids.clear();
+  _index.clear();
+  while ((int) _ids.size() < n) {
+    int id = anyId(rng);
+    if (_index.emplace(id, (int) _ids.size()).second)
+      _ids.push_back(id);
+  }
+
+  //
+  // spanning tree from vertex 0 ensures everything is reachable:
+  //
+  vector<unordered_set<int>> edges(n);
+
+  for (int v = 1; v < n; v++) {
+    int parent = deep ? v - 1 : uniform_int_distribution<int>(0, v - 1)(rng);
+    edges[parent].insert(v);
+  }
+
+  //
+  // extra edges; each vertex already has ~1 tree edge on average:
+  //
+  uniform_int_distribution<int> anyVertex(0, n - 1);
+  uniform_real_distribution<double> u(0.0, 1.0);
+
+  for (int v = 0; v < n; v++)
+  {
+    int extra;
+
+    if (powerlaw) {
+      // Pareto(alpha=2) has mean 2*xm; cap hubs at n/10 neighbors:
+      double x = (avgDegree / 2.0) / sqrt(1.0 - u(rng));
+      extra = (int) min(x, max(1.0, n / 10.0)) - 1;
+    }
+    else
+      extra = uniform_int_distribution<int>(0, 2 * (avgDegree - 1))(rng);
+
+    for (int e = 0; e < extra; e++)
+      edges[v].insert(anyVertex(rng));
+  }
+
+  _adj.assign(n, vector<int>());
+  for (int v = 0; v < n; v++)
+    for (int w : edges[v])
+      _adj[v].push_back(_ids[w]);
+
+  generate_costs(n, rng);
+}
+
+
+//
+// burn: consumes the given # of microseconds of time.
+//
+static void burn(double us)
+{
+  auto duration = chrono::nanoseconds((long long) (us * 1000.0));
+
+  if (_sleep) {
+    this_thread::sleep_for(duration);
+    return;
+  }
+
+  auto stop = chrono::steady_clock::now() + duration;
+  while (chrono::steady_clock::now() < stop)
+    ;
+}
+
+
+WorkGraph::WorkGraph()
+{
+  if (_refs++ == 0)
+    generate();
+}
+
+WorkGraph::WorkGraph(const WorkGraph& /*other*/)  // shares the one generated graph
+{
+  _refs++;
+}
+
+WorkGraph::~WorkGraph()
+{
+  if (--_refs == 0) {
+    _ids.clear();
+    _index.clear();
+    _adj.clear();
+    _costs.clear();
+  }
+}
+
+int WorkGraph::num_vertices()
+{
+  return (int) _ids.size();
+}
+
+int WorkGraph::start_vertex()
+{
+  return _ids[0];
+}
+
+std::vector<int> WorkGraph::do_work(int vertex)
+{
+  auto it = _index.find(vertex);
+  if (it == _index.end())
+    return std::vector<int>();
+
+  burn(_costs[it->second]);
+
+  return _adj[it->second];
+}
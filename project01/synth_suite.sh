@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Builds the WorkMatrix and WorkGraph apps against the synthetic workloads
+# (workmatrix-synth.cpp, workgraph-synth.cpp) and runs a fixed, seeded set
+# of workloads, so scheduler changes can be compared on any Linux box.
+#
+# Usage: ./synth_suite.sh [NumThreads]     (default: # of cores)
+
+THREADS=${1:-$(nproc)}
+SEED=${SEED:-1}
+
+cd "$(dirname "$0")"
+
+make -s synth || exit 1
+make -s -C project01-part02 synth || exit 1
+
+# name | environment
+MATRIX_WORKLOADS=(
+  "matrix-uniform|WM_SIZE=60 WM_MEAN_US=500 WM_DIST=uniform"
+  "matrix-heavy|WM_SIZE=60 WM_MEAN_US=500 WM_DIST=heavy"
+  "matrix-hotspot|WM_SIZE=60 WM_MEAN_US=500 WM_DIST=hotspot"
+)
+
+GRAPH_WORKLOADS=(
+  "graph-wide-uniform|WG_VERTICES=4000 WG_MEAN_US=500 WG_SHAPE=wide WG_DEGREE=uniform"
+  "graph-wide-powerlaw|WG_VERTICES=4000 WG_MEAN_US=500 WG_SHAPE=wide WG_DEGREE=powerlaw"
+  "graph-deep-uniform|WG_VERTICES=4000 WG_MEAN_US=500 WG_SHAPE=deep WG_DEGREE=uniform"
+  "graph-wide-heavy|WG_VERTICES=4000 WG_MEAN_US=500 WG_SHAPE=wide WG_DIST=heavy"
+  "graph-wide-hotspot|WG_VERTICES=4000 WG_MEAN_US=500 WG_SHAPE=wide WG_DIST=hotspot"
+)
+
+run() {
+  local name=$1 env=$2 app=$3
+  local secs
+  secs=$(env $env WM_SEED=$SEED WG_SEED=$SEED $app -t $THREADS | grep "Time:" | awk '{print $4}')
+  printf "%-22s %3d threads  %8s secs\n" "$name" "$THREADS" "$secs"
+}
+
+echo "=========================================="
+for w in "${MATRIX_WORKLOADS[@]}"; do
+  run "${w%%|*}" "${w#*|}" ./work-synth
+done
+for w in "${GRAPH_WORKLOADS[@]}"; do
+  run "${w%%|*}" "${w#*|}" ./project01-part02/work-synth
+done
+echo "=========================================="
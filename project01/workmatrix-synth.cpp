@@ -0,0 +1,180 @@
+/*workmatrix-synth.cpp*/
+
+//
+// Synthetic, source-level stand-in for the prebuilt workmatrix-*.o. Cell
+// costs are drawn from a seeded distribution when the matrix is created,
+// so runs are reproducible, and the work is a CPU-bound spin (or a sleep)
+// of that many microseconds. Build with "make synth".
+//
+// Since the WorkMatrix interface only has a default constructor, the
+// workload is configured via environment variables:
+//
+//   WM_SIZE     N, matrix is NxN                          (default 100)
+//   WM_DIST     uniform | heavy | hotspot                 (default uniform)
+//   WM_MEAN_US  mean cost per cell, in microseconds       (default 1000)
+//   WM_SEED     random seed                               (default 1)
+//   WM_WORK     spin | sleep                              (default spin)
+//
+// Distributions:
+//   uniform  cost ~ U(0, 2*mean)
+//   heavy    cost ~ Pareto(alpha=1.5), i.e. a few cells dominate
+//   hotspot  a handful of clustered regions that are ~50x costlier
+//
+// NOTE: WorkMatrix declares no data members (it must stay layout-compatible
+// with the prebuilt objects), so the cost table lives in this file.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+
+#include "workmatrix.h"
+
+using namespace std;
+
+
+//
+// Globals:
+//
+static int            _size = 0;
+static bool           _sleep = false;
+static vector<double> _costs;   // microseconds, row-major
+static int            _refs = 0;
+
+
+static int env_int(const char* name, int def)
+{
+  const char* v = getenv(name);
+  return (v != nullptr) ? atoi(v) : def;
+}
+
+static string env_str(const char* name, const char* def)
+{
+  const char* v = getenv(name);
+  return (v != nullptr) ? string(v) : string(def);
+}
+
+
+//
+// generate: fills the cost table according to the environment.
+//
+static void generate()
+{
+  _size = env_int("WM_SIZE", 100);
+  _sleep = (env_str("WM_WORK", "spin") == "sleep");
+
+  string dist = env_str("WM_DIST", "uniform");
+  double mean = env_int("WM_MEAN_US", 1000);
+  mt19937_64 rng(env_int("WM_SEED", 1));
+
+  int N = _size;
+  _costs.assign((size_t) N * N, 0.0);
+
+  if (dist == "heavy")
+  {
+    // Pareto with shape alpha has mean xm * alpha / (alpha-1):
+    double alpha = 1.5;
+    double xm = mean * (alpha - 1) / alpha;
+    uniform_real_distribution<double> u(0.0, 1.0);
+
+    for (auto& c : _costs)
+      c = min(xm / pow(1.0 - u(rng), 1.0 / alpha), 1000.0 * mean);
+  }
+  else if (dist == "hotspot")
+  {
+    // K hot spots of radius N/10; cells inside cost 50x the base cost:
+    int K = 4;
+    double radius = max(1.0, N / 10.0);
+    uniform_int_distribution<int> pos(0, N - 1);
+    vector<pair<int,int>> spots;
+
+    for (int k = 0; k < K; k++)
+      spots.push_back({ pos(rng), pos(rng) });
+
+    double total = 0.0;
+    for (int r = 0; r < N; r++)
+      for (int c = 0; c < N; c++) {
+        double w = 1.0;
+        for (auto& s : spots)
+          if (hypot(r - s.first, c - s.second) <= radius)
+            w = 50.0;
+        _costs[(size_t) r * N + c] = w;
+        total += w;
+      }
+
+    // scale so the mean is as requested:
+    double scale = mean * _costs.size() / total;
+    for (auto& c : _costs)
+      c *= scale;
+  }
+  else  // uniform:
+  {
+    if (dist != "uniform")
+      cout << "**Unknown WM_DIST '" << dist << "', using uniform" << endl;
+
+    uniform_real_distribution<double> u(0.0, 2.0 * mean);
+    for (auto& c : _costs)
+      c = u(rng);
+  }
+}
+
+
+//
+// burn: consumes the given # of microseconds of time.
+//
+static void burn(double us)
+{
+  auto duration = chrono::nanoseconds((long long) (us * 1000.0));
+
+  if (_sleep) {
+    this_thread::sleep_for(duration);
+    return;
+  }
+
+  auto stop = chrono::steady_clock::now() + duration;
+  while (chrono::steady_clock::now() < stop)
+    ;
+}
+
+
+WorkMatrix::WorkMatrix()
+{
+  if (_refs++ == 0)
+    generate();
+}
+
+WorkMatrix::WorkMatrix(const WorkMatrix& /*other*/)  // shares the one generated matrix
+{
+  _refs++;
+}
+
+WorkMatrix::~WorkMatrix()
+{
+  if (--_refs == 0)
+    _costs.clear();
+}
+
+int WorkMatrix::num_rows()
+{
+  return _size;
+}
+
+int WorkMatrix::num_cols()
+{
+  return _size;
+}
+
+bool WorkMatrix::do_work(int row, int col)
+{
+  if (row < 0 || row >= _size || col < 0 || col >= _size)
+    return false;
+
+  burn(_costs[(size_t) row * _size + col]);
+
+  return true;
+}
@@ -16,6 +16,9 @@
 #include <cassert>
 #include <cstdint>
 #include <math.h>
+#include <mpi.h>
+
+#include "trace.h"
 
 using namespace std;
 
@@ -62,4 +65,12 @@ uchar **ReadBitmapFile(char *filename, BITMAPFILEHEADER &bitmapFileHeader, BITMA
 void    WriteBitmapFile(char *filename, BITMAPFILEHEADER bitmapFileHeader, BITMAPINFOHEADER bitmapInfoHeader, uchar **image);
 
 /* ContrastStretch.cpp */
-uchar **ContrastStretch(uchar **image, int rows, int cols, int steps);
+void    ContrastStretch(uchar **image, int rows, int cols, int steps, int myRank, int numProcs);
+
+/* kernel.cpp */
+int stretch_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+int stretch_plane_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+void deinterleave_row(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r);
+void interleave_row(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r);
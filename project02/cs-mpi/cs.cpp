@@ -13,265 +13,145 @@
 #include "app.h"
 #include "matrix.h"
 #include <mpi.h>
+#include <utility>
 
 //
-// Given 9 values (imagine a pixel and its 8 surrounding neighbors), returns the median
-// value while also returning min and max values (via last 2 parameters)
+// StripOf: the rows of the image a process owns, as a strip of "count" rows starting at
+// row "first".  The image is split evenly, and main also keeps the extra rows (due to an
+// uneven split), which are the start of the image.
 //
-uchar median(uchar a, uchar b, uchar c, uchar d, uchar e, 
-						 uchar f, uchar g, uchar h, uchar i, uchar &min, uchar &max)
+// NOTE: every process must own at least 1 row, so the ghost rows passed along are always
+// real rows of the image; ContrastStretch halts if the image has fewer rows than that.
+//
+static void StripOf(int rank, int numProcs, int rows, int& first, int& count)
 {
-	uchar A[9];
-
-	A[0] = a;  // capture 9 values:
-	A[1] = b;
-	A[2] = c;
-	A[3] = d;
-	A[4] = e;
-	A[5] = f;
-	A[6] = g;
-	A[7] = h;
-	A[8] = i;
-
-	// selection sort:
-	for(int i=0; i < 8; i++)
-	{
-		int min = i;
-
-		// select smallest in subset:
-		for (int j=i+1; j < 9; j++)
-		{
-			if (A[j] < A[min])
-				min = j;
-		}
+	int chunkSize = rows / numProcs;
+	int extraSize = rows % numProcs;
 
-		// swap:
-		uchar temp = A[i];
-		A[i] = A[min];
-		A[min] = temp;
-	}//for
-
-	// return min, max & median of 9 elements:
-	min = A[0];
-	max = A[8];
-
-	return A[4];
+	first = (rank == 0) ? 0 : chunkSize * rank + extraSize;
+	count = (rank == 0) ? chunkSize + extraSize : chunkSize;
 }
 
 
 //
-// Given a pixel value (a single RGB value) P and it's 8 neighbors, returns the new
-// pixel value P' based on min & max values of neighbors.
+// Performs contrast stetch over the given image --- i.e. makes lighter colors lighter and
+// darker colors darker.
 //
-uchar NewPixelValue(uchar UL, uchar UP, uchar UR,
-										uchar L,  uchar P,  uchar R,
-										uchar DL, uchar DW, uchar DR, 
-	                  int stepby)
-{
-	uchar newp, med, min, max;
-	double ratio;
-
-	med = median(UL, UP, UR, L, P, R, DL, DW, DR, min, max);
-
-	if (min == max)  // pixels are all the same:
-		newp = min;
-	else
-	{
-		// are neighbors darker than pixel, or lighter?
-		ratio = (P - min) / (double) (max - min);
-
-		if (ratio < 0.5)  // darker, so make pixel darker if possible:
-		{
-			if (P > stepby) // beware of underflow:
-				newp = P - stepby;
-			else  
-				newp = 0;
-		}
-		else if (ratio > 0.5)  // lighter, so make pixel lighter if possible:
-		{
-			if (P < 255-stepby)  // beware of overflow:
-				newp = P + stepby;
-			else  
-				newp = 255;
-		}
-		else  // neither, so leave pixel alone:
-			newp = P;
-	}
-
-	// done:
-	return newp;
-}
-
-
+// NOTE: the image matrix is a 2D matrix of pixels.  However, each pixel is 3 colors RGB,
+// which means a "column" in the matrix is actually 3 columns: Blue, Green, and Red.  So
+// as we loop over the matrix, we loop by 3 as we go along the column.
 //
-// Copy over boundary rows to 2nd image matrix:
+// NOTE: everyone calls this, main with the image (workers with nullptr).  Each process
+// keeps its strip of the image (see StripOf) for all the steps: main scatters the image
+// once, then every step each process only exchanges its first & last rows with its
+// neighbors, and at the end main gathers the strips back into the image.  The matrices
+// are allocated once, not per step.
 //
-void copy_boundary(uchar** image2, uchar** image, int rows, int cols)
+void ContrastStretch(uchar **image, int rows, int cols, int steps, int myRank, int numProcs)
 {
-	int basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
+	if (rows < numProcs)
 	{
-		image2[0][basecol] = image[0][basecol];
-		image2[0][basecol + 1] = image[0][basecol + 1];
-		image2[0][basecol + 2] = image[0][basecol + 2];
+		if (myRank == 0)
+			cout << "** Image is too small for " << numProcs << " processes, halting..." << endl;
+		MPI_Abort(MPI_COMM_WORLD, 1 /*return code*/);
 	}
 
-	basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
-	{
-		image2[rows - 1][basecol] = image[rows - 1][basecol];
-		image2[rows - 1][basecol + 1] = image[rows - 1][basecol + 1];
-		image2[rows - 1][basecol + 2] = image[rows - 1][basecol + 2];
-	}
+	//
+	// Where everyone's strip is in the image, in uchars, for the scatter / gather:
+	//
+	int* counts = new int[numProcs];
+	int* displs = new int[numProcs];
 
-	for (int row = 0; row < rows; row++)
+	for (int p = 0; p < numProcs; p++)
 	{
-		image2[row][0] = image[row][0];
-		image2[row][1] = image[row][1];
-		image2[row][2] = image[row][2];
-	}
+		int first, count;
+		StripOf(p, numProcs, rows, first, count);
 
-	for (int row = 0; row < rows; row++)
-	{
-		image2[row][cols * 3 - 3] = image[row][cols * 3 - 3];
-		image2[row][cols * 3 - 2] = image[row][cols * 3 - 2];
-		image2[row][cols * 3 - 1] = image[row][cols * 3 - 1];
+		counts[p] = count * cols * 3;
+		displs[p] = first * cols * 3;
 	}
 
-}
-
-
-//
-// stretch_one_pixel:
-//
-void stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
-{
-	int prevrow = baserow - 1;  // row above
-	int nextrow = baserow + 1;  // row below
-
-	// columns are a little trickier, since a "column" is really 3 physical cols: RGB
-	int prevcol = basecol - 3;  // previous column start:
-	int nextcol = basecol + 3;  // next column start:
+	int first, myRows;
+	StripOf(myRank, numProcs, rows, first, myRows);
 
 	//
-	// now update each pixel based on nearest neighbors around that pixel:
+	// Our strip, with a ghost row above & below for our neighbors' rows, and a
+	// 2nd matrix of the same size to write each step into:
 	//
+	uchar **readImage = New2dMatrix<uchar>(myRows + 2, cols*3);
+	uchar **writeImage = New2dMatrix<uchar>(myRows + 2, cols*3);
 
-	// Blue:
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// Green:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// Red:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-}
+	TRACE_BEGIN("scatter");
+	MPI_Scatterv((image != nullptr) ? image[0] : nullptr, counts, displs, MPI_UNSIGNED_CHAR,
+		readImage[1], myRows * cols * 3, MPI_UNSIGNED_CHAR, 0 /* main */, MPI_COMM_WORLD);
+	TRACE_END("scatter");
 
-
-//
-// Performs contrast stetch over the given image --- i.e. makes lighter colors lighter and
-// darker colors darker.
-//
-// NOTE: the image matrix is a 2D matrix of pixels.  However, each pixel is 3 colors RGB,
-// which means a "column" in the matrix is actually 3 columns: Blue, Green, and Red.  So
-// as we loop over the matrix, we loop by 3 as we go along the column.
-//
-uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
-{
 	//
-	// First, we need a temporary 2D matrix of the same size:
+	// The 2nd matrix starts out as a copy, so the boundary rows & columns (which
+	// never change) are in place and we can swap pointers after each step:
 	//
-	uchar **readImage = New2dMatrix<uchar>(rows, cols*3);
-	uchar **writeImage = New2dMatrix<uchar>(rows, cols*3);
+	memcpy(writeImage[0], readImage[0], (myRows + 2) * cols * 3 * sizeof(uchar));
 
-	memcpy(readImage[0], image[0], rows * cols * 3 * sizeof(uchar));
+	int up = (myRank > 0) ? myRank - 1 : MPI_PROC_NULL;
+	int down = (myRank < numProcs - 1) ? myRank + 1 : MPI_PROC_NULL;
 
-	//
-	// copy the boundary rows into the temp image so we can swap
-	// pointers after each step:
-	//
-	copy_boundary(writeImage, readImage, rows, cols);
+	// the rows of our strip we compute, i.e. not the boundary rows of the image:
+	int firstRow = (myRank == 0) ? 2 : 1;
+	int lastRow = (myRank == numProcs - 1) ? myRows - 1 : myRows;
 
 	//
 	// Okay, now perform contrast stretching, one step at a time:
 	//
-	int step = 1;
-
-	while (step <= steps)
+	for (int step = 1; step <= steps; step++)
 	{
-		// cout << "** Step " << step << "..." << endl;
+		if (myRank == 0) {
+			cout << "** Step " << step << "..." << endl;
+			cout.flush();
+		}
+		TRACE_SCOPE("step");
+
+		//
+		// Exchange ghost rows: our last row goes *DOWN* into the top ghost row of
+		// the process below, and our first row *UP* into the bottom ghost row of
+		// the process above:
+		//
+		TRACE_BEGIN("halo");
+		MPI_Sendrecv(readImage[myRows], cols*3, MPI_UNSIGNED_CHAR, down, 0,
+			readImage[0], cols*3, MPI_UNSIGNED_CHAR, up, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		MPI_Sendrecv(readImage[1], cols*3, MPI_UNSIGNED_CHAR, up, 1,
+			readImage[myRows + 1], cols*3, MPI_UNSIGNED_CHAR, down, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		TRACE_END("halo");
 
 		//
-		// Okay, for each row (except boundary rows), lighten/darken pixel:
+		// Okay, for each row of our strip (except boundary rows), lighten/darken pixel:
 		//
-		for (int row = 1; row < rows-1; row++)
+		TRACE_BEGIN("compute");
+		for (int row = firstRow; row <= lastRow; row++)
 		{
-			//
-			// And for each column (except boundary columns), lighten/darken pixel:
-			//
-			// columns are a little trickier, since a "column" is really 
-			// 3 physical cols: RGB
-			//
-			int basecol = 3;  // start of column (skip boundary column 0):
-
-			for (int col = 1; col < cols-1; col++, basecol += 3)
-			{
-				stretch_one_pixel(writeImage, readImage, row, basecol);
-			}
+			stretch_row(writeImage[row], readImage[row - 1], readImage[row], readImage[row + 1], cols, 1 /*stepby*/);
 		}
+		TRACE_END("compute");
 
 		//
 		// flip the image pointers and step:
 		//
 		std::swap(readImage, writeImage);
 
-		step++;
-
 	}//while-each-step
 
 	//
-	// done!
+	// done! main collects the strips:
 	//
+	TRACE_BEGIN("gather");
+	MPI_Gatherv(readImage[1], myRows * cols * 3, MPI_UNSIGNED_CHAR,
+		(image != nullptr) ? image[0] : nullptr, counts, displs, MPI_UNSIGNED_CHAR, 0 /* main */, MPI_COMM_WORLD);
+	TRACE_END("gather");
+
+	Delete2dMatrix(readImage);
 	Delete2dMatrix(writeImage);
 
-	return readImage;
+	delete[] counts;
+	delete[] displs;
 }
 
 // main MPI process
@@ -280,58 +160,19 @@ uchar** main_process(uchar** image, int rows, int cols, int steps, int numProcs)
 	cout << "main starting..." << endl;
 	cout.flush();
 
-	uchar** finalImage = New2dMatrix<uchar>(rows, cols*3);
-	
-	memcpy(finalImage[0], image[0], rows * cols * 3 * sizeof(uchar));
-
 	int count = 1;
 	// First we send the number of rows and columns of the image
 	MPI_Bcast(&rows, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
 	MPI_Bcast(&cols, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
-	
-	// We send the extra size to estimate the starting row
-	int extraSize = rows%numProcs;
-	MPI_Bcast(&extraSize, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
-	
+
 	// We send the no. of steps we have to perform contrast streching
 	MPI_Bcast(&steps, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
 
-	for (int step = 0; step < steps; step++){
-		cout << "** Step " << step + 1 << "..." << endl;
-		cout.flush();
-		// Send image to workers:
-		count = rows * cols * 3;
-		MPI_Bcast(finalImage[0], count, MPI_UNSIGNED_CHAR, 0 /* main */, MPI_COMM_WORLD);
-		
-		// Instead of doing nothing, the main process also performs it's own 
-		// share of contrast streching
-		int chunkSize = rows/numProcs;
-		int extraSize = rows%numProcs;
-		
-		uchar** processedImage;
-		if (numProcs == 1) {
-			processedImage = ContrastStretch(&finalImage[0], chunkSize + extraSize, cols, 1);
-		}
-		else {
-			processedImage = ContrastStretch(&finalImage[0], chunkSize + extraSize + 1, cols, 1);
-		}
-		memcpy(finalImage[0], processedImage[0], (chunkSize + extraSize) * cols * 3 * sizeof(uchar));
-	
-		// Receive the remaining results from the workers
-		for (int w = 1; w < numProcs; w++) {
-	
-			int src = w;
-			int count = chunkSize * cols * 3;
-			int tag = 0;
-	
-			// Receive chunk of results from worker:
-			int row = chunkSize * w + extraSize;
-			MPI_Recv(finalImage[row], count, MPI_UNSIGNED_CHAR, src, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		}
-		
-	}
+	// Instead of doing nothing, the main process also performs it's own
+	// share of contrast streching, on the first strip of the image
+	ContrastStretch(image, rows, cols, steps, 0 /* main */, numProcs);
 
-	return finalImage;
+	return image;
 }
 
 // worker MPI process
@@ -341,57 +182,16 @@ void worker_process(int myRank, int numProcs)
 	cout.flush();
 
 	// First we receive size of matrix rows x cols x 3 from main
-
-	// Main is 0
-	int src = 0;
-	int count = 1;  
-	int tag = 0;
+	int count = 1;
 	int rows, cols;
 
 	MPI_Bcast(&rows, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
 	MPI_Bcast(&cols, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
 
-	// We receive the extrasize to estimate the startRow
-	int extraSize;
-	MPI_Bcast(&extraSize, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
-
 	// We receive the no. of steps we have to perform contrast streching
 	int steps;
 	MPI_Bcast(&steps, count, MPI_INT, 0 /* main */, MPI_COMM_WORLD);
 
-	// We allocate space for image, and receive the image from main
-	uchar** image = New2dMatrix<uchar>(rows, cols*3);
-
-	for (int step = 0; step < steps; step++) {
-		// NOTE: we know that underlying "matrix" is single 1D array, pointed to image[0] 
-		// and of length rows * cols * 3.
-		  count = rows * cols * 3;
-		MPI_Bcast(image[0], count, MPI_UNSIGNED_CHAR, src /* main */, MPI_COMM_WORLD);
-	
-		// We have the image. We perform contrast streching for our block of rows
-		int chunkSize = rows / numProcs;
-		int startRow = chunkSize * myRank + extraSize;
-	
-		uchar** processedImage;
-	
-		if (myRank == numProcs - 1) {
-			processedImage = ContrastStretch(&image[startRow - 1], chunkSize + 1, cols, 1);
-		}
-	
-		else {
-			processedImage = ContrastStretch(&image[startRow - 1], chunkSize + 2, cols, 1);
-		}
-	
-		// Done, send our results back to main
-		int dest = 0;
-		count = chunkSize * cols * 3;
-		tag = 0;
-	
-		MPI_Send(processedImage[1], count, MPI_UNSIGNED_CHAR, dest, tag, MPI_COMM_WORLD);
-
-	}
-
-	// cleanup
-	Delete2dMatrix(image);
-
-}
\ No newline at end of file
+	// We perform contrast streching for our strip of rows, which main sends us
+	ContrastStretch(nullptr, rows, cols, steps, myRank, numProcs);
+}
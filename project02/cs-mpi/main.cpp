@@ -33,6 +33,7 @@ int main(int argc, char* argv[])
 	MPI_Init(&argc, &argv);
 	MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+	TRACE_INIT();  // line up the ranks' trace timelines
 
 	if(myRank > 0) {
 		worker_process(myRank, numProcs);
@@ -114,6 +115,8 @@ int main(int argc, char* argv[])
 		
 	}
 	
+	TRACE_WRITE("trace.json");
+
 	MPI_Finalize();
 	return 0;
 }
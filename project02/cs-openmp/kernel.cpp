@@ -0,0 +1,473 @@
+/* kernel.cpp */
+
+//
+// Vectorized row kernel for the contrast stretch: computes the new value of
+// every channel of an image row from the row and the rows above and below.
+//
+// For each channel value P:
+//
+//   min, max = min & max of its 3x3 neighborhood (branchless byte min/max)
+//
+//   P' = P - stepby  if P - min < max - P   (darker, saturating at 0)
+//        P + stepby  if P - min > max - P   (lighter, saturating at 255)
+//        P           otherwise
+//
+// Comparing P - min against max - P is the exact integer form of comparing
+// the ratio (P - min) / (max - min) against 0.5, including min == max (both
+// are 0, so P is left alone). Both differences fit in a uchar since min <= P
+// <= max, so everything stays byte-wide.
+//
+// The 3x3 min & max are computed separably: the min & max of each column of
+// 3 (above, cur, below) once, then of the 3 columns around P. Adjacent
+// neighborhoods share 2 of their 3 columns, so that's 8 min/max operations
+// per value instead of 16.
+//
+// The kernel is applied to 16, 32 or 64 adjacent channel values at a time
+// with SSE4.1, AVX2 or AVX-512BW byte min/max, whichever the CPU supports
+// (checked once, at run time), and to single values for the rest of the row.
+// It works on interleaved BGR rows (stretch_row, neighbors are 3 uchars
+// apart) as well as on planar rows of a single channel (stretch_plane_row,
+// neighbors are adjacent); the latter is what planar.h images use, along
+// with the SIMD de-interleave / re-interleave of rows below.
+//
+
+#include "app.h"
+
+#include <cstring>
+
+
+//
+// vector types, 16/32/64 uchars:
+//
+typedef uchar vec16 __attribute__((vector_size(16)));
+typedef uchar vec32 __attribute__((vector_size(32)));
+typedef uchar vec64 __attribute__((vector_size(64)));
+
+// element-wise min / max, for vectors as well as single uchars:
+#define VMIN(a, b) ((a) < (b) ? (a) : (b))
+#define VMAX(a, b) ((a) < (b) ? (b) : (a))
+
+#define INLINE static inline __attribute__((always_inline))
+
+
+//
+// load / store sizeof(V) uchars, unaligned:
+//
+template<typename V>
+INLINE void load(V& v, const uchar* p)
+{
+	memcpy(&v, p, sizeof(V));
+}
+
+template<typename V>
+INLINE void store(uchar* p, const V& v)
+{
+	memcpy(p, &v, sizeof(V));
+}
+
+
+//
+// columns: min & max of each column (above, cur, below) of sizeof(V)
+// adjacent channel values.
+//
+template<typename V>
+INLINE void columns(uchar* mins, uchar* maxs, const uchar* above, const uchar* cur, const uchar* below)
+{
+	V a, b, c;
+	load(a, above);  load(b, cur);  load(c, below);
+
+	V lo = VMIN(a, b);
+	V hi = VMAX(a, b);
+
+	store(mins, (V) VMIN(lo, c));
+	store(maxs, (V) VMAX(hi, c));
+}
+
+
+//
+// stretch3: new values of sizeof(V) adjacent channel values, given the min
+// & max of each column around them (a neighbor is PIXEL uchars left / right:
+// 3 in a BGR row, 1 in a plane) and the broadcast stepby; adds 1 to the
+// lanes of "changes" whose value changed.
+//
+template<typename V, int PIXEL>
+INLINE void stretch3(uchar* dst, const uchar* cur, const uchar* mins, const uchar* maxs,
+	const V& step, V& changes)
+{
+	V p, m0, m1, m2, x0, x1, x2;
+
+	load(p, cur);
+	load(m0, mins - PIXEL);  load(m1, mins);  load(m2, mins + PIXEL);
+	load(x0, maxs - PIXEL);  load(x1, maxs);  load(x2, maxs + PIXEL);
+
+	V mn = VMIN(VMIN(m0, m1), m2);
+	V mx = VMAX(VMAX(x0, x1), x2);
+
+	V lo = p - mn;  // how much darker the darkest neighbor is
+	V hi = mx - p;  // how much lighter the lightest neighbor is
+
+	V white = V{} + (uchar) 255;
+	V darker = p - VMIN(p, step);
+	V lighter = p + VMIN((V) (white - p), step);
+
+	V newp = (lo < hi) ? darker : ((hi < lo) ? lighter : p);
+
+	store(dst, newp);
+	changes += (V) (newp != p) & 1;
+}
+
+
+//
+// sum: adds up the lanes of v, from lane "first" on.
+//
+template<typename V>
+INLINE int sum(const V& v, int first = 0)
+{
+	uchar lanes[sizeof(V)];
+	memcpy(lanes, &v, sizeof(V));
+	memset(lanes, 0, first);
+
+	int total = 0;
+	int k = 0;
+
+	for (; k + 8 <= (int) sizeof(V); k += 8)  // 8 lanes at a time, as 4 x 16 bits:
+	{
+		uint64_t x;
+		memcpy(&x, lanes + k, 8);
+
+		x = (x & 0x00FF00FF00FF00FFull) + ((x >> 8) & 0x00FF00FF00FF00FFull);
+		total += (int) ((x * 0x0001000100010001ull) >> 48);
+	}
+
+	for (; k < (int) sizeof(V); k++)
+		total += lanes[k];
+
+	return total;
+}
+
+
+//
+// Work on a row is done in chunks of CHUNK channel values, so the column
+// mins & maxs of a chunk stay in L1 cache between the 2 passes.
+//
+#define CHUNK 1024
+
+//
+// columns_with: column mins & maxs of n channel values, sizeof(V) at a time;
+// what's left is done as one more vector that overlaps the previous one, or
+// one at a time if n is less than a vector.
+//
+template<typename V>
+INLINE void columns_with(uchar* mins, uchar* maxs, const uchar* above, const uchar* cur, const uchar* below, int n)
+{
+	int i = 0;
+
+	for (; i + (int) sizeof(V) <= n; i += sizeof(V))
+		columns<V>(mins + i, maxs + i, above + i, cur + i, below + i);
+
+	if (i < n && n >= (int) sizeof(V))
+		columns<V>(mins + n - sizeof(V), maxs + n - sizeof(V), above + n - sizeof(V), cur + n - sizeof(V), below + n - sizeof(V));
+	else
+		for (; i < n; i++)
+			columns<uchar>(mins + i, maxs + i, above + i, cur + i, below + i);
+}
+
+
+//
+// stretch_row_with: the whole row, a chunk at a time: first the min & max
+// of every column of 3 values (above, cur, below) in the chunk, then each
+// channel value's neighborhood min & max from the 3 columns around it. So
+// each column is reduced once instead of once for each of its 3 neighbors,
+// which halves the min/max work.
+//
+// Within a chunk, sizeof(V) channels at a time. What's left is done as one
+// more vector that overlaps the previous one (those values are just written
+// again, but counted once), or one at a time if it's narrower than a vector.
+//
+template<typename V, int PIXEL>
+INLINE int stretch_row_with(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby)
+{
+	// skip boundary column 0 and width-1, a "column" is PIXEL uchars
+	int n = width * PIXEL - 2 * PIXEL;
+	dst += PIXEL;  above += PIXEL;  cur += PIXEL;  below += PIXEL;
+
+	uchar mins[CHUNK + 2 * PIXEL], maxs[CHUNK + 2 * PIXEL];
+
+	V step = V{} + (uchar) stepby;
+	int total = 0;
+
+	for (int start = 0; start < n; start += CHUNK)
+	{
+		int len = std::min(CHUNK, n - start);
+
+		// column mins & maxs for [start - PIXEL, start + len + PIXEL):
+		columns_with<V>(mins, maxs, above + start - PIXEL, cur + start - PIXEL, below + start - PIXEL, len + 2 * PIXEL);
+
+		uchar* d = dst + start;
+		const uchar* c = cur + start;
+		const uchar* mn = mins + PIXEL;
+		const uchar* mx = maxs + PIXEL;
+
+		V changes = V{};
+		int i = 0;
+
+		for (int blocks = 0; i + (int) sizeof(V) <= len; i += sizeof(V))
+		{
+			stretch3<V, PIXEL>(d + i, c + i, mn + i, mx + i, step, changes);
+
+			if (++blocks == 255)  // before the byte-wide counts overflow:
+			{
+				total += sum(changes);
+				changes = V{};
+				blocks = 0;
+			}
+		}
+
+		total += sum(changes);
+
+		if (i < len && len >= (int) sizeof(V))
+		{
+			int last = len - sizeof(V);
+
+			changes = V{};
+			stretch3<V, PIXEL>(d + last, c + last, mn + last, mx + last, step, changes);
+			total += sum(changes, i - last);
+		}
+		else
+		{
+			uchar step1 = (uchar) stepby;
+
+			for (; i < len; i++)
+			{
+				uchar changed = 0;
+				stretch3<uchar, PIXEL>(d + i, c + i, mn + i, mx + i, step1, changed);
+				total += changed;
+			}
+		}
+	}
+
+	return total;
+}
+
+
+//
+// stretch_with: stretch_row_with for a BGR row (pixel = 3) or a plane row
+// (pixel = 1).
+//
+template<typename V>
+INLINE int stretch_with(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby, int pixel)
+{
+	if (pixel == 3)
+		return stretch_row_with<V, 3>(dst, above, cur, below, width, stepby);
+	else
+		return stretch_row_with<V, 1>(dst, above, cur, below, width, stepby);
+}
+
+
+//
+// de-interleave / re-interleave, 16 pixels (48 uchars) at a time: each
+// plane gathers every 3rd uchar of the 3 vectors, in 2 byte shuffles.
+//
+typedef uchar mask16 __attribute__((vector_size(16)));
+
+static const mask16 DEINTERLEAVE[3][2] = {
+	{ {  0,  3,  6,  9, 12, 15, 18, 21, 24, 27, 30,  0,  0,  0,  0,  0 },
+	  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 17, 20, 23, 26, 29 } },
+	{ {  1,  4,  7, 10, 13, 16, 19, 22, 25, 28, 31,  0,  0,  0,  0,  0 },
+	  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 18, 21, 24, 27, 30 } },
+	{ {  2,  5,  8, 11, 14, 17, 20, 23, 26, 29,  0,  0,  0,  0,  0,  0 },
+	  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 16, 19, 22, 25, 28, 31 } },
+};
+
+static const mask16 INTERLEAVE[3][2] = {  // B & G first, then R
+	{ {  0, 16,  0,  1, 17,  0,  2, 18,  0,  3, 19,  0,  4, 20,  0,  5 },
+	  {  0,  1, 16,  3,  4, 17,  6,  7, 18,  9, 10, 19, 12, 13, 20, 15 } },
+	{ { 21,  0,  6, 22,  0,  7, 23,  0,  8, 24,  0,  9, 25,  0, 10, 26 },
+	  {  0, 21,  2,  3, 22,  5,  6, 23,  8,  9, 24, 11, 12, 25, 14, 15 } },
+	{ {  0, 11, 27,  0, 12, 28,  0, 13, 29,  0, 14, 30,  0, 15, 31,  0 },
+	  { 26,  1,  2, 27,  4,  5, 28,  7,  8, 29, 10, 11, 30, 13, 14, 31 } },
+};
+
+template<bool SIMD>
+INLINE void deinterleave_with(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r)
+{
+	int i = 0;
+	uchar* planes[3] = { b, g, r };
+
+	if (SIMD)
+		for (; i + 16 <= width; i += 16)
+		{
+			vec16 v0, v1, v2;
+			load(v0, bgr + 3 * i);  load(v1, bgr + 3 * i + 16);  load(v2, bgr + 3 * i + 32);
+
+			for (int c = 0; c < 3; c++)
+			{
+				vec16 t = __builtin_shuffle(v0, v1, DEINTERLEAVE[c][0]);
+				store(planes[c] + i, (vec16) __builtin_shuffle(t, v2, DEINTERLEAVE[c][1]));
+			}
+		}
+
+	for (; i < width; i++)
+	{
+		b[i] = bgr[3 * i];
+		g[i] = bgr[3 * i + 1];
+		r[i] = bgr[3 * i + 2];
+	}
+}
+
+template<bool SIMD>
+INLINE void interleave_with(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r)
+{
+	int i = 0;
+
+	if (SIMD)
+		for (; i + 16 <= width; i += 16)
+		{
+			vec16 vb, vg, vr;
+			load(vb, b + i);  load(vg, g + i);  load(vr, r + i);
+
+			for (int q = 0; q < 3; q++)
+			{
+				vec16 t = __builtin_shuffle(vb, vg, INTERLEAVE[q][0]);
+				store(bgr + 3 * i + 16 * q, (vec16) __builtin_shuffle(t, vr, INTERLEAVE[q][1]));
+			}
+		}
+
+	for (; i < width; i++)
+	{
+		bgr[3 * i] = b[i];
+		bgr[3 * i + 1] = g[i];
+		bgr[3 * i + 2] = r[i];
+	}
+}
+
+
+//
+// the kernels, compiled once per instruction set:
+//
+typedef int  (*StretchRowFn)(uchar*, const uchar*, const uchar*, const uchar*, int, int, int);
+typedef void (*DeinterleaveFn)(const uchar*, int, uchar*, uchar*, uchar*);
+typedef void (*InterleaveFn)(uchar*, int, const uchar*, const uchar*, const uchar*);
+
+struct Kernels {
+	StretchRowFn   stretch_row;
+	DeinterleaveFn deinterleave_row;
+	InterleaveFn   interleave_row;
+};
+
+static int stretch_row_scalar(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby, int pixel)
+{
+	return stretch_with<uchar>(dst, above, cur, below, width, stepby, pixel);
+}
+
+static void deinterleave_row_scalar(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r)
+{
+	deinterleave_with<false>(bgr, width, b, g, r);
+}
+
+static void interleave_row_scalar(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r)
+{
+	interleave_with<false>(bgr, width, b, g, r);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.1")))
+static int stretch_row_sse41(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby, int pixel)
+{
+	return stretch_with<vec16>(dst, above, cur, below, width, stepby, pixel);
+}
+
+__attribute__((target("sse4.1")))
+static void deinterleave_row_sse41(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r)
+{
+	deinterleave_with<true>(bgr, width, b, g, r);
+}
+
+__attribute__((target("sse4.1")))
+static void interleave_row_sse41(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r)
+{
+	interleave_with<true>(bgr, width, b, g, r);
+}
+
+__attribute__((target("avx2")))
+static int stretch_row_avx2(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby, int pixel)
+{
+	return stretch_with<vec32>(dst, above, cur, below, width, stepby, pixel);
+}
+
+__attribute__((target("avx512bw")))
+static int stretch_row_avx512(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby, int pixel)
+{
+	return stretch_with<vec64>(dst, above, cur, below, width, stepby, pixel);
+}
+
+#endif
+
+
+//
+// select_kernels: the widest versions the CPU supports.
+//
+static Kernels select_kernels()
+{
+	Kernels k = { stretch_row_scalar, deinterleave_row_scalar, interleave_row_scalar };
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse4.1"))
+		k = { stretch_row_sse41, deinterleave_row_sse41, interleave_row_sse41 };
+	if (__builtin_cpu_supports("avx2"))
+		k.stretch_row = stretch_row_avx2;
+	if (__builtin_cpu_supports("avx512bw"))
+		k.stretch_row = stretch_row_avx512;
+#endif
+
+	return k;
+}
+
+static const Kernels _kernels = select_kernels();
+
+
+//
+// stretch_row: computes the new values of one image row, width pixels wide,
+// into dst, given the row (cur) and the rows above and below it. The first
+// and last pixel (boundary columns) of dst are not written. Returns the # of
+// channel values that changed.
+//
+int stretch_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby)
+{
+	return _kernels.stretch_row(dst, above, cur, below, width, stepby, 3);
+}
+
+
+//
+// stretch_plane_row: stretch_row for one row of a single-channel plane.
+//
+int stretch_plane_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby)
+{
+	return _kernels.stretch_row(dst, above, cur, below, width, stepby, 1);
+}
+
+
+//
+// deinterleave_row / interleave_row: splits a BGR row, width pixels wide,
+// into its B, G and R planes, and back.
+//
+void deinterleave_row(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r)
+{
+	_kernels.deinterleave_row(bgr, width, b, g, r);
+}
+
+void interleave_row(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r)
+{
+	_kernels.interleave_row(bgr, width, b, g, r);
+}
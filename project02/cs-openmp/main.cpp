@@ -4,7 +4,10 @@
 // Performs a contrast stretch over a Windows bitmap (.bmp) file, making lighter pixels
 // lighter and darker pixels darker.
 //
-// Usage: cs infile.bmp outfile.bmp steps
+// Usage: cs infile.bmp outfile.bmp steps [fuse]
+//
+// where fuse is the # of steps done per sweep over the image (default: as many as
+// fit the cache).
 //
 // << YOUR NAME >>
 //
@@ -24,14 +27,15 @@ int main(int argc, char* argv[])
 	char *infile;
 	char *outfile;
 	int   steps;
+	int   fuse = 0;
 
 	//
 	// process command-line args to program:
 	//
-	if (argc != 4)
+	if (argc != 4 && argc != 5)
 	{
 		cout << endl;
-		cout << "Usage: cs infile.bmp outfile.bmp steps" << endl;
+		cout << "Usage: cs infile.bmp outfile.bmp steps [fuse]" << endl;
 		cout << endl;
 		return 0;
 	}
@@ -39,12 +43,16 @@ int main(int argc, char* argv[])
 	infile = argv[1];
 	outfile = argv[2];
 	steps = atoi(argv[3]);
+	if (argc == 5)
+		fuse = atoi(argv[4]);
 
 	cout << endl;
 	cout << "** Starting Contrast Stretch **" << endl;
 	cout << "   Input file:  " << infile << endl;
 	cout << "   Output file: " << outfile << endl;
 	cout << "   Steps:       " << steps << endl;
+	if (fuse > 0)
+		cout << "   Fuse:        " << fuse << endl;
 	cout << endl;
 
 	//
@@ -70,7 +78,7 @@ int main(int argc, char* argv[])
 
   auto start = chrono::high_resolution_clock::now();
 
-	image = ContrastStretch(image, rows, cols, steps);
+	image = ContrastStretch(image, rows, cols, steps, fuse);
 
   auto stop = chrono::high_resolution_clock::now();
   auto diff = stop - start;
@@ -82,6 +90,8 @@ int main(int argc, char* argv[])
 	cout << endl;
 	cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
 
+	TRACE_WRITE("trace.json");
+
 	cout << "** Writing bitmap..." << endl;
 	WriteBitmapFile(outfile, bitmapFileHeader, bitmapInfoHeader, image);
 
@@ -0,0 +1,178 @@
+/* planar.h */
+
+//
+// PlanarImage: an image stored as 3 separate planes (B, G and R) instead of
+// interleaved BGR pixels, so that within a row each channel is a contiguous,
+// unit-stride run of uchars --- what the vector kernels want.
+//
+// Every plane row starts 64-byte aligned and has PLANAR_PAD uchars of padding
+// on both sides, and every plane has a guard row above row 0 and below the
+// last row, so vector code may read a little past the edges of the image.
+// Padding and guard rows are zero.
+//
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+
+#define PLANAR_ALIGN 64
+#define PLANAR_PAD   64
+
+struct PlanarImage {
+	int    rows, cols;  // in pixels
+	size_t stride;      // uchars from one plane row to the next
+	uchar* data;        // all 3 planes
+	uchar* planes[3];   // row 0, column 0 of B, G and R
+
+	uchar* row(int plane, int r) const { return planes[plane] + r * stride; }
+};
+
+
+//
+// PlanarStride: uchars from one plane row to the next, for images cols pixels wide.
+//
+inline size_t PlanarStride(int cols)
+{
+	return (PLANAR_PAD + cols + PLANAR_PAD + PLANAR_ALIGN - 1) / PLANAR_ALIGN * PLANAR_ALIGN;
+}
+
+
+//
+// NewPlanarImage: allocates a ROWSxCOLS planar image.
+//
+inline PlanarImage NewPlanarImage(int rows, int cols)
+{
+	PlanarImage image;
+
+	image.rows = rows;
+	image.cols = cols;
+	image.stride = PlanarStride(cols);
+
+	size_t planeSize = (rows + 2) * image.stride;  // + guard rows
+
+	image.data = (uchar*) aligned_alloc(PLANAR_ALIGN, 3 * planeSize);
+	memset(image.data, 0, 3 * planeSize);
+
+	for (int c = 0; c < 3; c++)
+		image.planes[c] = image.data + c * planeSize + image.stride + PLANAR_PAD;
+
+	return image;
+}
+
+
+//
+// DeletePlanarImage: returns memory associated with an image returned by NewPlanarImage.
+//
+inline void DeletePlanarImage(PlanarImage& image)
+{
+	free(image.data);
+	image.data = nullptr;
+}
+
+
+//
+// ToPlanar / FromPlanar: copy a BGR image matrix (see matrix.h) of the same
+// size into the planar image, and back.
+//
+inline void ToPlanar(PlanarImage& planar, uchar** image)
+{
+	for (int r = 0; r < planar.rows; r++)
+		deinterleave_row(image[r], planar.cols, planar.row(0, r), planar.row(1, r), planar.row(2, r));
+}
+
+inline void FromPlanar(uchar** image, const PlanarImage& planar)
+{
+	for (int r = 0; r < planar.rows; r++)
+		interleave_row(image[r], planar.cols, planar.row(0, r), planar.row(1, r), planar.row(2, r));
+}
+
+
+//
+// Temporal blocking: rather than streaming the whole image through memory
+// once per step, StretchFused does k steps in a single sweep down the image.
+// At sweep position r it applies step 1 to row r, step 2 to row r-2, ...,
+// step t to row r-2(t-1); each of those only needs the 3 rows around it
+// from the step before, which earlier sweep positions computed. So every
+// intermediate step keeps just 4 rows, in a small ring buffer that stays
+// in cache, and only the result of step k is written back to memory.
+// Nothing is computed twice, and the result is exactly that of k separate
+// steps. (With a skew of 1 instead of 2, a row would be read right after
+// it's written, at an offset, which stalls store-to-load forwarding.)
+//
+// To split the image among threads, each one sweeps its own band of rows,
+// plus (for the intermediate steps) the rows of the neighboring bands that
+// its band depends on: k-t rows on each side for step t. That's a trapezoid
+// of redundant work at the band edges, k(k-1) rows per band per k steps.
+//
+
+//
+// FuseSteps: # of steps to fuse per sweep for images cols pixels wide, such
+// that the ring buffers (see NewFuseRing) take at most half the L2 cache.
+//
+inline int FuseSteps(int cols)
+{
+	long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (l2 <= 0)
+		l2 = 256 * 1024;
+
+	long perStep = 4 * 3 * PlanarStride(cols);  // 4 rows of 3 planes per intermediate step
+	long k = 1 + (l2 / 2) / perStep;
+
+	return (int) std::max(1L, std::min(k, 16L));
+}
+
+
+//
+// NewFuseRing: the ring buffers to fuse k steps, one set per thread.
+//
+inline PlanarImage NewFuseRing(int cols, int k)
+{
+	return NewPlanarImage(std::max(1, 4 * (k - 1)), cols);
+}
+
+
+//
+// StretchFused: advances rows [first, last) of src by k steps into dst,
+// using the given ring buffers; the boundary rows & columns of dst must
+// already hold those of src. The other rows of dst are not touched.
+//
+inline void StretchFused(PlanarImage& dst, const PlanarImage& src, int first, int last, int k,
+	PlanarImage& ring, int stepby)
+{
+	int rows = src.rows, cols = src.cols;
+
+	// row j of plane c after step t (0 = src):
+	auto level = [&](int c, int t, int j) -> uchar* {
+		if (t == 0 || j == 0 || j == rows - 1)  // boundary rows never change:
+			return src.row(c, j);
+		return ring.row(c, 4 * (t - 1) + j % 4);
+	};
+
+	for (int r = first - (k - 1); r < last + 2 * (k - 1); r++)
+	{
+		for (int t = 1; t <= k; t++)
+		{
+			int j = r - 2 * (t - 1);
+
+			// rows step t has to compute for this band, if any:
+			if (j < std::max(1, first - (k - t)) || j >= std::min(rows - 1, last + (k - t)))
+				continue;
+
+			for (int c = 0; c < 3; c++)  // Blue, Green, Red:
+			{
+				uchar* out = (t == k) ? dst.row(c, j) : level(c, t, j);
+
+				stretch_plane_row(out, level(c, t - 1, j - 1), level(c, t - 1, j), level(c, t - 1, j + 1), cols, stepby);
+
+				if (t < k)  // boundary columns never change:
+				{
+					out[0] = src.row(c, j)[0];
+					out[cols - 1] = src.row(c, j)[cols - 1];
+				}
+			}
+		}
+	}
+}
@@ -12,197 +12,7 @@
 
 #include "app.h"
 #include "matrix.h"
-
-
-//
-// Given 9 values (imagine a pixel and its 8 surrounding neighbors), returns the median
-// value while also returning min and max values (via last 2 parameters)
-//
-uchar median(uchar a, uchar b, uchar c, uchar d, uchar e, 
-						 uchar f, uchar g, uchar h, uchar i, uchar &min, uchar &max)
-{
-	uchar A[9];
-
-	A[0] = a;  // capture 9 values:
-	A[1] = b;
-	A[2] = c;
-	A[3] = d;
-	A[4] = e;
-	A[5] = f;
-	A[6] = g;
-	A[7] = h;
-	A[8] = i;
-
-	// selection sort:
-	for(int i=0; i < 8; i++)
-	{
-		int min = i;
-
-		// select smallest in subset:
-		for (int j=i+1; j < 9; j++)
-		{
-			if (A[j] < A[min])
-				min = j;
-		}
-
-		// swap:
-		uchar temp = A[i];
-		A[i] = A[min];
-		A[min] = temp;
-	}//for
-
-	// return min, max & median of 9 elements:
-	min = A[0];
-	max = A[8];
-
-	return A[4];
-}
-
-
-//
-// Given a pixel value (a single RGB value) P and it's 8 neighbors, returns the new
-// pixel value P' based on min & max values of neighbors.
-//
-uchar NewPixelValue(uchar UL, uchar UP, uchar UR,
-										uchar L,  uchar P,  uchar R,
-										uchar DL, uchar DW, uchar DR, 
-	                  int stepby)
-{
-	uchar newp, med, min, max;
-	double ratio;
-
-	med = median(UL, UP, UR, L, P, R, DL, DW, DR, min, max);
-
-	if (min == max)  // pixels are all the same:
-		newp = min;
-	else
-	{
-		// are neighbors darker than pixel, or lighter?
-		ratio = (P - min) / (double) (max - min);
-
-		if (ratio < 0.5)  // darker, so make pixel darker if possible:
-		{
-			if (P > stepby) // beware of underflow:
-				newp = P - stepby;
-			else  
-				newp = 0;
-		}
-		else if (ratio > 0.5)  // lighter, so make pixel lighter if possible:
-		{
-			if (P < 255-stepby)  // beware of overflow:
-				newp = P + stepby;
-			else  
-				newp = 255;
-		}
-		else  // neither, so leave pixel alone:
-			newp = P;
-	}
-
-	// done:
-	return newp;
-}
-
-
-//
-// Copy over boundary rows to 2nd image matrix:
-//
-void copy_boundary(uchar** image2, uchar** image, int rows, int cols)
-{
-	int basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
-	{
-		image2[0][basecol] = image[0][basecol];
-		image2[0][basecol + 1] = image[0][basecol + 1];
-		image2[0][basecol + 2] = image[0][basecol + 2];
-	}
-
-	basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
-	{
-		image2[rows - 1][basecol] = image[rows - 1][basecol];
-		image2[rows - 1][basecol + 1] = image[rows - 1][basecol + 1];
-		image2[rows - 1][basecol + 2] = image[rows - 1][basecol + 2];
-	}
-
-	for (int row = 0; row < rows; row++)
-	{
-		image2[row][0] = image[row][0];
-		image2[row][1] = image[row][1];
-		image2[row][2] = image[row][2];
-	}
-
-	for (int row = 0; row < rows; row++)
-	{
-		image2[row][cols * 3 - 3] = image[row][cols * 3 - 3];
-		image2[row][cols * 3 - 2] = image[row][cols * 3 - 2];
-		image2[row][cols * 3 - 1] = image[row][cols * 3 - 1];
-	}
-
-}
-
-
-//
-// stretch_one_pixel:
-//
-void stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
-{
-	int prevrow = baserow - 1;  // row above
-	int nextrow = baserow + 1;  // row below
-
-	// columns are a little trickier, since a "column" is really 3 physical cols: RGB
-	int prevcol = basecol - 3;  // previous column start:
-	int nextcol = basecol + 3;  // next column start:
-
-	//
-	// now update each pixel based on nearest neighbors around that pixel:
-	//
-
-	// Blue:
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// Green:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// Red:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-}
+#include "planar.h"
 
 
 //
@@ -213,62 +23,65 @@ void stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
 // which means a "column" in the matrix is actually 3 columns: Blue, Green, and Red.  So
 // as we loop over the matrix, we loop by 3 as we go along the column.
 //
-uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
+// The steps are done "fuse" at a time in one sweep over the image (see StretchFused in
+// planar.h); 0 picks a number that fits the cache.
+//
+uchar **ContrastStretch(uchar **image, int rows, int cols, int steps, int fuse)
 {
 	//
-	// First, we need a temporary 2D matrix of the same size:
+	// First, we work on a planar copy of the image (separate B, G and R planes,
+	// see planar.h), so each channel's neighbors are adjacent in memory. And we
+	// need a temporary one of the same size; both start out as copies of the
+	// image, so the boundary rows & columns are in place and we can swap after
+	// each sweep:
 	//
-	uchar **image2 = New2dMatrix<uchar>(rows, cols*3);
+	PlanarImage planes = NewPlanarImage(rows, cols);
+	PlanarImage planes2 = NewPlanarImage(rows, cols);
 
-	//
-	// copy the boundary rows into the temp image so we can swap
-	// pointers after each step:
-	//
-	copy_boundary(image2, image, rows, cols);
+	ToPlanar(planes, image);
+	ToPlanar(planes2, image);
+
+	if (fuse <= 0)
+		fuse = FuseSteps(cols);
+
+	PlanarImage ring = NewFuseRing(cols, fuse);
 
 	//
-	// Okay, now perform contrast stretching, one step at a time:
+	// Okay, now perform contrast stretching, up to fuse steps at a time:
 	//
 	int step = 1;
 
 	while (step <= steps)
 	{
-		cout << "** Step " << step << "..." << endl;
+		TRACE_SCOPE("step");
+
+		int k = min(fuse, steps - step + 1);
+
+		for (int s = step; s < step + k; s++)
+			cout << "** Step " << s << "..." << endl;
 
 		//
-		// Okay, for each row (except boundary rows), lighten/darken pixel:
+		// Okay, all the rows (except boundary rows), k steps:
 		//
-		for (int row = 1; row < rows-1; row++)
-		{
-			//
-			// And for each column (except boundary columns), lighten/darken pixel:
-			//
-			// columns are a little trickier, since a "column" is really 
-			// 3 physical cols: RGB
-			//
-			int basecol = 3;  // start of column (skip boundary column 0):
-
-			for (int col = 1; col < cols-1; col++, basecol += 3)
-			{
-				stretch_one_pixel(image2, image, row, basecol);
-			}
-		}
+		StretchFused(planes2, planes, 1, rows - 1, k, ring, 1 /*stepby*/);
 
 		//
-		// flip the image pointers and step:
+		// flip the images and step:
 		//
-		uchar** tempi = image;
-		image = image2;
-		image2 = tempi;
+		swap(planes, planes2);
 
-		step++;
+		step += k;
 
 	}//while-each-step
 
 	//
-	// done!
+	// done! back to BGR, in the memory passed to us:
 	//
-	Delete2dMatrix(image2);
+	FromPlanar(image, planes);
+
+	DeletePlanarImage(planes);
+	DeletePlanarImage(planes2);
+	DeletePlanarImage(ring);
 
 	return image;
 }
@@ -17,11 +17,14 @@
 #include <chrono>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <math.h>
 #include <unistd.h>
 #include <mpi.h>
 
 #include "matrix.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -32,6 +35,29 @@ using namespace std;
 typedef unsigned char uchar;
 
 
+//
+// Block: how the image is split among the processes, and which part is
+// ours. The processes form a 2D grid (a Cartesian communicator), and each
+// one gets a block of rows x cols of the image, rows/cols differing by at
+// most 1 from block to block if the image doesn't divide evenly.
+//
+// A process keeps its block in a (rows+2h) x (cols+2h) pixel matrix, where
+// h is the halo depth: the block itself starts at [h][h], surrounded by h
+// ghost rows / columns on each side for the neighboring blocks' pixels.
+//
+struct Block {
+	MPI_Comm grid;          // 2D Cartesian communicator of all the processes
+	int dims[2];            // # of process rows & columns in the grid
+	int coords[2];          // our row & column in the grid
+	int imageRows, imageCols;
+	int firstRow, firstCol; // of our block in the image
+	int rows, cols;         // of our block, in pixels
+	int halo;               // depth of the ghost ring, 1..MAX_HALO
+};
+
+#define MAX_HALO 16
+
+
 //
 // bitmap-related types:
 //
@@ -68,4 +94,13 @@ uchar **ReadBitmapFile(char *filename, BITMAPFILEHEADER &bitmapFileHeader, BITMA
 void    WriteBitmapFile(char *filename, BITMAPFILEHEADER bitmapFileHeader, BITMAPINFOHEADER bitmapInfoHeader, uchar **image);
 
 /* ContrastStretch.cpp */
-uchar **ContrastStretch(uchar **image, int rows, int cols, int steps);
+uchar **ContrastStretch(uchar **image, const Block& block, int steps, int check, bool verbose);
+int     ChooseHalo(const Block& block, int halo);
+
+/* kernel.cpp */
+int stretch_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+int stretch_plane_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+void deinterleave_row(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r);
+void interleave_row(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r);
@@ -11,211 +11,473 @@
 //
 
 #include "app.h"
+#include "steplog.h"
 
 
 //
-// Given 9 values (imagine a pixel and its 8 surrounding neighbors), returns the median
-// value while also returning min and max values (via last 2 parameters)
+// Ghost rows & columns are exchanged with persistent, non-blocking requests:
+// set up once, then started before every batch of steps. Pixels go *DOWN*
+// with DOWN_TAG (our last rows into the top ghost rows of the block below),
+// *UP* with UP_TAG, and likewise *RIGHT* and *LEFT*.
 //
-uchar median(uchar a, uchar b, uchar c, uchar d, uchar e, 
-						 uchar f, uchar g, uchar h, uchar i, uchar &min, uchar &max)
+#define DOWN_TAG  0
+#define UP_TAG    1
+#define RIGHT_TAG 2
+#define LEFT_TAG  3
+
+//
+// While computing, we check on the exchange in flight every HALO_POLL_ROWS
+// rows, so MPI makes progress and we see when it's done.
+//
+#define HALO_POLL_ROWS 16
+
+//
+// Deep halos: with a ghost ring h pixels deep (Block::halo), a process does
+// h steps per exchange. Step k of the h also computes the h-k deep part of
+// the ring that step k+1 will need, redundantly, since the neighbors compute
+// those pixels too. The part of the ring that's computed shrinks by 1 each
+// step, and after h steps the block is exactly what it would be with an
+// exchange every step. That's h times fewer messages, and reductions, for
+// a little extra compute: a good trade when blocks are small.
+//
+// ChooseHalo picks h by timing an exchange, a reduction and a step on our
+// block, and then minimizing the modeled time per step.
+//
+#define HALO_CALIBRATE_ROUNDS 5
+
+
+//
+// Pixel: row r, col c of our block in its matrix. Rows & cols are 1-based:
+// the block is [1, rows] x [1, cols], and the ghosts are around it.
+//
+static inline uchar* Pixel(uchar** image, const Block& block, int r, int c)
 {
-	uchar A[9];
-
-	A[0] = a;  // capture 9 values:
-	A[1] = b;
-	A[2] = c;
-	A[3] = d;
-	A[4] = e;
-	A[5] = f;
-	A[6] = g;
-	A[7] = h;
-	A[8] = i;
-
-	// selection sort:
-	for(int i=0; i < 8; i++)
-	{
-		int min = i;
+	return image[block.halo - 1 + r] + (block.halo - 1 + c) * 3;
+}
 
-		// select smallest in subset:
-		for (int j=i+1; j < 9; j++)
-		{
-			if (A[j] < A[min])
-				min = j;
-		}
 
-		// swap:
-		uchar temp = A[i];
-		A[i] = A[min];
-		A[min] = temp;
-	}//for
+//
+// ColumnType: block.halo columns of a block's matrix, from its first data
+// row down: 3 x halo uchars out of every matrix row. Columns are sent &
+// received in place with it, no copying into contiguous buffers.
+//
+static MPI_Datatype ColumnType(const Block& block)
+{
+	int h = block.halo;
+	MPI_Datatype column;
 
-	// return min, max & median of 9 elements:
-	min = A[0];
-	max = A[8];
+	MPI_Type_vector(block.rows, 3 * h, (block.cols + 2 * h) * 3, MPI_UNSIGNED_CHAR, &column);
+	MPI_Type_commit(&column);
 
-	return A[4];
+	return column;
 }
 
 
 //
-// Given a pixel value (a single RGB value) P and it's 8 neighbors, returns the new
-// pixel value P' based on min & max values of neighbors.
+// Halo: the persistent requests of the ghost exchange of one image buffer.
+// Columns go first, then rows: the rows include the ghost columns just
+// received, so the corners of our ghost ring arrive from the diagonal
+// neighbors without messages of their own.
 //
-uchar NewPixelValue(uchar UL, uchar UP, uchar UR,
-										uchar L,  uchar P,  uchar R,
-										uchar DL, uchar DW, uchar DR, 
-	                  int stepby)
+struct Halo {
+	MPI_Request columns[4];  // receive left & right ghost columns, send ours
+	MPI_Request rows[4];     // receive ghost rows above & below, send ours
+};
+
+static void HaloInit(uchar** image, const Block& block, MPI_Datatype column, Halo& halo)
 {
-	uchar newp, med, min, max;
-	double ratio;
+	int rows = block.rows, cols = block.cols, h = block.halo;
+	int up, down, left, right;
+
+	MPI_Cart_shift(block.grid, 0, 1, &up, &down);
+	MPI_Cart_shift(block.grid, 1, 1, &left, &right);
+
+	MPI_Recv_init(Pixel(image, block, 1, 1 - h), 1, column, left, RIGHT_TAG, block.grid, &halo.columns[0]);
+	MPI_Recv_init(Pixel(image, block, 1, cols + 1), 1, column, right, LEFT_TAG, block.grid, &halo.columns[1]);
+	MPI_Send_init(Pixel(image, block, 1, cols - h + 1), 1, column, right, RIGHT_TAG, block.grid, &halo.columns[2]);
+	MPI_Send_init(Pixel(image, block, 1, 1), 1, column, left, LEFT_TAG, block.grid, &halo.columns[3]);
 
-	med = median(UL, UP, UR, L, P, R, DL, DW, DR, min, max);
+	int count = h * (cols + 2 * h) * 3;  // h whole matrix rows, ghost columns included
 
-	if (min == max)  // pixels are all the same:
-		newp = min;
-	else
+	MPI_Recv_init(Pixel(image, block, 1 - h, 1 - h), count, MPI_UNSIGNED_CHAR, up, DOWN_TAG, block.grid, &halo.rows[0]);
+	MPI_Recv_init(Pixel(image, block, rows + 1, 1 - h), count, MPI_UNSIGNED_CHAR, down, UP_TAG, block.grid, &halo.rows[1]);
+	MPI_Send_init(Pixel(image, block, rows - h + 1, 1 - h), count, MPI_UNSIGNED_CHAR, down, DOWN_TAG, block.grid, &halo.rows[2]);
+	MPI_Send_init(Pixel(image, block, 1, 1 - h), count, MPI_UNSIGNED_CHAR, up, UP_TAG, block.grid, &halo.rows[3]);
+}
+
+static void HaloFree(Halo& halo)
+{
+	for (int r = 0; r < 4; r++)
 	{
-		// are neighbors darker than pixel, or lighter?
-		ratio = (P - min) / (double) (max - min);
+		MPI_Request_free(&halo.columns[r]);
+		MPI_Request_free(&halo.rows[r]);
+	}
+}
 
-		if (ratio < 0.5)  // darker, so make pixel darker if possible:
-		{
-			if (P > stepby) // beware of underflow:
-				newp = P - stepby;
-			else  
-				newp = 0;
-		}
-		else if (ratio > 0.5)  // lighter, so make pixel lighter if possible:
+
+//
+// Exchange: a started ghost exchange (columns or rows), and when it began
+// and arrived, to tell how much of it was hidden behind computing.
+//
+struct Exchange {
+	MPI_Request* requests;  // 4 of them
+	double       started, arrived;
+	int          done;
+};
+
+static void StartExchange(Exchange& x, MPI_Request requests[4])
+{
+	x.requests = requests;
+	x.done = 0;
+
+	MPI_Startall(4, requests);
+	x.started = MPI_Wtime();
+}
+
+static void PollExchange(Exchange& x)
+{
+	if (x.done)
+		return;
+
+	MPI_Testall(4, x.requests, &x.done, MPI_STATUSES_IGNORE);
+	if (x.done)
+		x.arrived = MPI_Wtime();
+}
+
+//
+// FinishExchange: waits for the exchange to be done; adds the time it was
+// in flight while we computed to "hidden", and the time waited to "exposed".
+//
+static void FinishExchange(Exchange& x, double& hidden, double& exposed)
+{
+	double computed = MPI_Wtime();
+
+	if (!x.done)
+		MPI_Waitall(4, x.requests, MPI_STATUSES_IGNORE);
+
+	double waited = MPI_Wtime();
+
+	hidden += (x.done ? x.arrived : computed) - x.started;
+	exposed += waited - computed;
+}
+
+
+//
+// Reach: the rows & cols to compute (inclusive) while "depth" rows & cols of
+// the ghost ring are still needed by later steps: our block and that much of
+// the ring around it, but never the boundary of the image.
+//
+static void Reach(const Block& block, int depth, int& r0, int& r1, int& c0, int& c1)
+{
+	r0 = max(2 - block.firstRow, 1 - depth);
+	r1 = min(block.imageRows - 1 - block.firstRow, block.rows + depth);
+	c0 = max(2 - block.firstCol, 1 - depth);
+	c1 = min(block.imageCols - 1 - block.firstCol, block.cols + depth);
+}
+
+
+//
+// StretchRow: lightens/darkens cols [c0, c1] of row r of image into image2;
+// returns the # of channel values that changed.
+//
+static int StretchRow(uchar** image2, uchar** image, const Block& block, int r, int c0, int c1)
+{
+	if (c0 > c1)
+		return 0;
+
+	// stretch_row skips the first & last column it's given:
+	return stretch_row(Pixel(image2, block, r, c0 - 1), Pixel(image, block, r - 1, c0 - 1),
+		Pixel(image, block, r, c0 - 1), Pixel(image, block, r + 1, c0 - 1), c1 - c0 + 3, 1 /*stepby*/);
+}
+
+
+//
+// StretchBlock: lightens/darkens rows [r0, r1] x cols [c0, c1] (inclusive)
+// of image into image2, checking on the exchange in flight (if any) now and
+// then. Returns the # of channel values of OUR BLOCK that changed; those in
+// the ghost ring are the neighbors' to count.
+//
+static int StretchBlock(uchar** image2, uchar** image, const Block& block, int r0, int r1, int c0, int c1, Exchange* x)
+{
+	if (c0 > c1)
+		return 0;
+
+	int diffs = 0;
+
+	for (int row = r0; row <= r1; row++)
+	{
+		if (row < 1 || row > block.rows)  // ghost row:
+			StretchRow(image2, image, block, row, c0, c1);
+		else
 		{
-			if (P < 255-stepby)  // beware of overflow:
-				newp = P + stepby;
-			else  
-				newp = 255;
+			StretchRow(image2, image, block, row, c0, min(c1, 0));
+			diffs += StretchRow(image2, image, block, row, max(c0, 1), min(c1, block.cols));
+			StretchRow(image2, image, block, row, max(c0, block.cols + 1), c1);
 		}
-		else  // neither, so leave pixel alone:
-			newp = P;
+
+		if (x != nullptr && row % HALO_POLL_ROWS == 0)
+			PollExchange(*x);
 	}
 
-	// done:
-	return newp;
+	return diffs;
+}
+
+
+//
+// StretchExchanging: StretchBlock of rows [r0, r1] x cols [c0, c1] while
+// exchanging the ghosts they need, computing first what doesn't need them:
+// the interior of our block while the ghost columns are exchanged, then the
+// rest of those rows, which need only ghost columns, while the ghost rows
+// are exchanged, and finally the rest.
+//
+static int StretchExchanging(uchar** image2, uchar** image, const Block& block, Halo& halo,
+	int r0, int r1, int c0, int c1, double& hidden, double& exposed)
+{
+	// the interior, if any; otherwise it's all "left" of / "above" it:
+	int i0 = max(r0, 2), i1 = min(r1, block.rows - 1);
+	int j0 = max(c0, 2), j1 = min(c1, block.cols - 1);
+
+	if (i0 > i1)
+		i0 = r1 + 1, i1 = r1;
+	if (j0 > j1)
+		j0 = c1 + 1, j1 = c1;
+
+	Exchange x;
+	int diffs = 0;
+
+	TRACE_BEGIN("interior");
+	StartExchange(x, halo.columns);
+	diffs += StretchBlock(image2, image, block, i0, i1, j0, j1, &x);
+	TRACE_END("interior");
+
+	TRACE_BEGIN("halo-wait");
+	FinishExchange(x, hidden, exposed);
+	TRACE_END("halo-wait");
+
+	TRACE_BEGIN("edges");
+	StartExchange(x, halo.rows);
+	diffs += StretchBlock(image2, image, block, i0, i1, c0, j0 - 1, &x);
+	diffs += StretchBlock(image2, image, block, i0, i1, j1 + 1, c1, &x);
+	TRACE_END("edges");
+
+	TRACE_BEGIN("halo-wait");
+	FinishExchange(x, hidden, exposed);
+	TRACE_END("halo-wait");
+
+	TRACE_BEGIN("edges");
+	diffs += StretchBlock(image2, image, block, r0, i0 - 1, c0, c1, nullptr);
+	diffs += StretchBlock(image2, image, block, i1 + 1, r1, c0, c1, nullptr);
+	TRACE_END("edges");
+
+	return diffs;
 }
 
 
 //
-// Copy over boundary rows to 2nd image matrix:
+// TimeExchange: average time of a ghost exchange with the given halo depth,
+// on scratch matrices.
 //
-void copy_boundary(uchar** image2, uchar** image, int rows, int cols)
+static double TimeExchange(const Block& grid, int h)
 {
-	int basecol = 0;
+	Block block = grid;
+	block.halo = h;
+
+	uchar** image = New2dMatrix<uchar>(block.rows + 2 * h, (block.cols + 2 * h) * 3);
+	memset(image[0], 0, (size_t) (block.rows + 2 * h) * (block.cols + 2 * h) * 3);
 
-	for (int col = 0; col < cols; col++, basecol += 3)
+	MPI_Datatype column = ColumnType(block);
+	Halo halo;
+
+	HaloInit(image, block, column, halo);
+
+	double start = 0.0;
+
+	for (int round = 0; round <= HALO_CALIBRATE_ROUNDS; round++)
 	{
-		image2[0][basecol] = image[0][basecol];
-		image2[0][basecol + 1] = image[0][basecol + 1];
-		image2[0][basecol + 2] = image[0][basecol + 2];
+		if (round == 1)  // after a warm-up round:
+			start = MPI_Wtime();
+
+		MPI_Startall(4, halo.columns);
+		MPI_Waitall(4, halo.columns, MPI_STATUSES_IGNORE);
+		MPI_Startall(4, halo.rows);
+		MPI_Waitall(4, halo.rows, MPI_STATUSES_IGNORE);
 	}
 
-	basecol = 0;
+	double time = (MPI_Wtime() - start) / HALO_CALIBRATE_ROUNDS;
+
+	HaloFree(halo);
+	MPI_Type_free(&column);
+	Delete2dMatrix(image);
 
-	for (int col = 0; col < cols; col++, basecol += 3)
+	return time;
+}
+
+
+//
+// ChooseHalo: the halo depth to use; "halo" if that's > 0, else whichever
+// minimizes the modeled time per step. Either way at most MAX_HALO, and at
+// most the rows & cols of the smallest block, since ghosts only come from
+// the adjacent blocks. All processes get the same answer.
+//
+int ChooseHalo(const Block& block, int halo)
+{
+	int most = min(MAX_HALO, min(block.imageRows / block.dims[0], block.imageCols / block.dims[1]));
+	most = max(1, most);
+
+	if (halo > 0 || most == 1)
+		return max(1, min(halo, most));
+
+	//
+	// Measure: an exchange 1 and "most" deep (in between, time grows about
+	// linearly with the bytes), a reduction of the diffs, and a step over
+	// our block, per pixel:
+	//
+	double exchange1 = TimeExchange(block, 1);
+	double exchangeMost = TimeExchange(block, most);
+
+	double start = MPI_Wtime();
+	for (int round = 0; round < HALO_CALIBRATE_ROUNDS; round++)
 	{
-		image2[rows - 1][basecol] = image[rows - 1][basecol];
-		image2[rows - 1][basecol + 1] = image[rows - 1][basecol + 1];
-		image2[rows - 1][basecol + 2] = image[rows - 1][basecol + 2];
+		int diffs = 0, totalDiffs = 0;
+		MPI_Reduce(&diffs, &totalDiffs, 1, MPI_INT, MPI_SUM, 0, block.grid);
+		MPI_Bcast(&totalDiffs, 1, MPI_INT, 0, block.grid);
 	}
+	double reduce = (MPI_Wtime() - start) / HALO_CALIBRATE_ROUNDS;
+
+	Block one = block;
+	one.halo = 1;
 
-	for (int row = 0; row < rows; row++)
+	uchar** image = New2dMatrix<uchar>(block.rows + 2, (block.cols + 2) * 3);
+	uchar** image2 = New2dMatrix<uchar>(block.rows + 2, (block.cols + 2) * 3);
+	memset(image[0], 0, (size_t) (block.rows + 2) * (block.cols + 2) * 3);
+
+	double pixel = 1e30;
+	for (int round = 0; round < HALO_CALIBRATE_ROUNDS; round++)
 	{
-		image2[row][0] = image[row][0];
-		image2[row][1] = image[row][1];
-		image2[row][2] = image[row][2];
+		start = MPI_Wtime();
+		StretchBlock(image2, image, one, 1, block.rows, 1, block.cols, nullptr);
+		pixel = min(pixel, (MPI_Wtime() - start) / ((double) block.rows * block.cols));
 	}
 
-	for (int row = 0; row < rows; row++)
+	Delete2dMatrix(image);
+	Delete2dMatrix(image2);
+
+	//
+	// Model: time per step with depth h is an exchange h deep, a reduction,
+	// and h steps over what Reach says (our block, plus a shrinking ring),
+	// all divided by h. The slowest process sets the pace:
+	//
+	double cost[MAX_HALO];
+
+	for (int h = 1; h <= most; h++)
 	{
-		image2[row][cols * 3 - 3] = image[row][cols * 3 - 3];
-		image2[row][cols * 3 - 2] = image[row][cols * 3 - 2];
-		image2[row][cols * 3 - 1] = image[row][cols * 3 - 1];
+		double pixels = 0.0;
+
+		for (int depth = 0; depth < h; depth++)
+		{
+			int r0, r1, c0, c1;
+			Reach(block, depth, r0, r1, c0, c1);
+			pixels += (double) max(0, r1 - r0 + 1) * max(0, c1 - c0 + 1);
+		}
+
+		double exchange = exchange1 + (exchangeMost - exchange1) * (h - 1) / (most - 1);
+
+		cost[h - 1] = (exchange + reduce + pixel * pixels) / h;
 	}
 
+	MPI_Allreduce(MPI_IN_PLACE, cost, most, MPI_DOUBLE, MPI_MAX, block.grid);
+
+	int best = 1;
+	for (int h = 2; h <= most; h++)
+		if (cost[h - 1] < cost[best - 1])
+			best = h;
+
+	return best;
 }
 
 
 //
-// stretch_one_pixel:
+// Convergence checks: every "check" steps, the diffs of those steps are
+// summed across all processes with one non-blocking MPI_Iallreduce, and we
+// go on with the next steps while it's in flight; we only wait for it at
+// the next check. So checking costs no synchronization in the critical
+// path, and only 1 collective per "check" steps.
 //
-int stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
+// If it turns out the image converged (a step changed nothing), the steps
+// done since were speculative, but there's nothing to roll back: a step
+// that changes nothing leaves the image at a fixed point, which later steps
+// don't change either. So we just stop.
+//
+struct Check {
+	int*        diffs;       // ours, for each step checked
+	int*        totalDiffs;  // all processes'
+	int         first;       // 1st step checked
+	int         count;       // # of steps checked
+	MPI_Request request;
+};
+
+
+//
+// FinishCheck: waits for the check in flight, if any, and outputs its steps
+// (if there's a log) up to the one the image converged at, if any; returns
+// true if it did. lastStep is set to the last step output.
+//
+static bool FinishCheck(Check& check, StepLog* log, int& lastStep)
 {
-	int prevrow = baserow - 1;  // row above
-	int nextrow = baserow + 1;  // row below
+	if (check.request == MPI_REQUEST_NULL)
+		return false;
 
-	// columns are a little trickier, since a "column" is really 3 physical cols: RGB
-	int prevcol = basecol - 3;  // previous column start:
-	int nextcol = basecol + 3;  // next column start:
+	TRACE_BEGIN("reduce-wait");
+	MPI_Wait(&check.request, MPI_STATUS_IGNORE);
+	TRACE_END("reduce-wait");
 
-	//
-	// now update each pixel based on nearest neighbors around that pixel:
-	//
-	int changes = 0;
-
-	// Blue:
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	if (image2[baserow][basecol] != image[baserow][basecol]) {
-		changes++;
-	}
+	for (int k = 0; k < check.count; k++)
+	{
+		lastStep = check.first + k;
 
-	// Green:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	if (image2[baserow][basecol] != image[baserow][basecol]) {
-		changes++;
-	}
+		if (log != nullptr)
+			log->post("** Step " + to_string(lastStep) + "...\nDiff " + to_string(check.totalDiffs[k]) + "\n");
 
-	// Red:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	if (image2[baserow][basecol] != image[baserow][basecol]) {
-		changes++;
+		if (check.totalDiffs[k] == 0)
+			return true;
 	}
 
-	return changes;
+	return false;
+}
+
+
+//
+// ReportHalo: rank 0 outputs how much of each rank's ghost exchange was
+// hidden behind computing, and how much it had to wait for.
+//
+static void ReportHalo(const Block& block, double hidden, double exposed)
+{
+	int myRank, numProcs;
+	MPI_Comm_rank(block.grid, &myRank);
+	MPI_Comm_size(block.grid, &numProcs);
+
+	double mine[2] = { hidden, exposed };
+	double* all = (myRank == 0) ? new double[2 * numProcs] : nullptr;
+
+	MPI_Gather(mine, 2, MPI_DOUBLE, all, 2, MPI_DOUBLE, 0, block.grid);
+
+	if (myRank == 0)
+	{
+		cout << endl;
+		cout << "** Ghost exchange (ms):" << endl;
+		cout << "   " << setw(6) << "rank" << setw(12) << "hidden" << setw(12) << "exposed" << endl;
+
+		for (int p = 0; p < numProcs; p++)
+		{
+			cout << "   " << setw(6) << p
+			     << fixed << setprecision(3)
+			     << setw(12) << all[2 * p] * 1000.0
+			     << setw(12) << all[2 * p + 1] * 1000.0 << endl;
+		}
+
+		cout.unsetf(ios::floatfield);
+		delete[] all;
+	}
 }
 
 
@@ -227,123 +489,118 @@ int stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
 // which means a "column" in the matrix is actually 3 columns: Blue, Green, and Red.  So
 // as we loop over the matrix, we loop by 3 as we go along the column.
 //
-// NOTE: every process is responsible for processing only a CHUNK of the image.  This
-// chunk is rows x cols in size.  We assume that the image passed in contains not only
-// the pixel data for the CHUNK, but also memory set aside for ghost row storage.
+// NOTE: every process is responsible for processing only a BLOCK of the image (see Block
+// in app.h).  The image passed in is this block, surrounded by a ring of ghost rows and
+// columns block.halo deep.  The stretched block is returned, likewise surrounded by a
+// ghost ring.
+//
+// NOTE: convergence is checked every "check" steps (see Check above).  If verbose, the
+// master outputs the diffs of every step, else just the # of steps at the end.
 //
-uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
+uchar **ContrastStretch(uchar **image, const Block& block, int steps, int check, bool verbose)
 {
-	int tag = 0;
 	int myRank;
-	int numProcs;
-	MPI_Status status;
 
-	uchar** original_image = image;
+	MPI_Comm_rank(block.grid, &myRank);  // my proc id in the grid (rank 0 = main)
 
-	MPI_Comm_size(MPI_COMM_WORLD, &numProcs);  // number of processes involved in run:
-	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);    // my proc id: 0 <= myRank < numProcs:
+	int rows = block.rows, cols = block.cols, h = block.halo;
 
 	//
-	// First, EVERYONE needs a temporary 2D matrix of the same size as THEIR CHUNK (include
-	// memory for ghost rows so that temp matrix is the same size, which makes the processing
-	// loop below easier to write since indices line up one-for-one):
+	// First, EVERYONE needs a temporary 2D matrix of the same size as THEIR BLOCK (and its
+	// ghost ring, so that indices line up one-for-one).  It starts out as a copy, so the
+	// pixels we don't compute --- those on the boundary of the image --- are in place and
+	// we can swap after each step:
 	//
-	uchar **image2 = New2dMatrix<uchar>(rows+2, cols*3);  // worst-case: +2 ghost rows
+	uchar **image2 = New2dMatrix<uchar>(rows + 2 * h, (cols + 2 * h) * 3);
+
+	memcpy(image2[0], image[0], (size_t) (rows + 2 * h) * (cols + 2 * h) * 3);
 
 	//
-	// Okay, processes on the boundary of the image (the master and last worker, i.e.
-	// processes that own top and bottom chunks of image) have one fewer row to process
-	// since we don't process the boundary rows.  If we adjust now, this makes the 
-	// processing loop MUCH cleaner:
+	// Persistent requests for the ghost exchange, one set per image buffer
+	// since we swap buffers after each step (set 0 is for the original
+	// image, set 1 for image2):
 	//
-	if (myRank == 0)  // main:
-		rows--;
-	if (myRank == numProcs-1)  // last worker:
-		rows--;
+	MPI_Datatype column = ColumnType(block);
+	Halo halo[2];
+
+	HaloInit(image, block, column, halo[0]);
+	HaloInit(image2, block, column, halo[1]);
 
 	//
-	// Okay, now perform contrast stretching, one step at a time:
+	// The ghost ring may hold pixels of the boundary of the image, which are
+	// never computed but read, from either buffer, so fill both rings once:
 	//
-	int step = 1;
-	bool converged = false;
-
-	// The algorithm converges when we have reached the maximum number of steps or
-	// when the images stops changing for every worker
-	while (step <= steps && !converged)
+	for (int k = 0; k < 2; k++)
 	{
-		if (myRank == 0)
-		  cout << "** Step " << step << "..." << endl;
+		MPI_Startall(4, halo[k].columns);
+		MPI_Waitall(4, halo[k].columns, MPI_STATUSES_IGNORE);
+		MPI_Startall(4, halo[k].rows);
+		MPI_Waitall(4, halo[k].rows, MPI_STATUSES_IGNORE);
+	}
 
-		// Master computes the total differences across all processes
-		int totalDiffs = 0;
-		
-		// Each process computes the differences for their own chunk
-		int diffs = 0;
+	int current = 0;  // set for the image we're reading from
 
-		//cout << myRank << " (" << host << "): Step " << step << "..." << endl;
+	// time the exchange was in flight while computing, and time we waited:
+	double hidden = 0.0, exposed = 0.0;
 
-		//
-		// Exchange "ghost" rows, i.e. we need rows above/below our matrix, and our
-		// neighbors likewise need our first/last rows:
-		//
-		// 1 of 2: everyone send their last data row *DOWN* to the next proc, and receive 
-		// that row from the process above them and store into first (top) ghost row:
-		//
+	//
+	// Convergence checks, every "check" steps, 2 sets of buffers: one for the
+	// check in flight, one for the steps since:
+	//
+	Check checks[2];
 
-		int dest = (myRank < numProcs - 1) ? myRank + 1 : MPI_PROC_NULL;
-		int src = (myRank > 0) ? myRank - 1 : MPI_PROC_NULL;
+	for (int c = 0; c < 2; c++)
+	{
+		checks[c].diffs = new int[check];
+		checks[c].totalDiffs = new int[check];
+		checks[c].count = 0;
+		checks[c].request = MPI_REQUEST_NULL;
+	}
 
-		MPI_Sendrecv(image[rows], cols*3, MPI_UNSIGNED_CHAR, dest, tag, 
-			image[0], cols*3, MPI_UNSIGNED_CHAR, src, tag, MPI_COMM_WORLD, &status);
+	Check* filling = &checks[0];   // diffs of the steps since the last check
+	Check* inFlight = &checks[1];  // the last check, being reduced
 
-		// 
-		// 2 of 2: everyone send their first data row *UP* to the previous proc, and receive
-		// that row from the process below them and store into their last (bottom) ghost row:
-		//
+	// rank 0's per-step output, if any, is written in the background --- if
+	// MPI lets us have a 2nd thread, else as we go:
+	int provided;
+	MPI_Query_thread(&provided);
 
-		dest = (myRank > 0) ? myRank - 1 : MPI_PROC_NULL;
-		src = (myRank < numProcs - 1) ? myRank + 1 : MPI_PROC_NULL;
+	StepLog* log = (myRank == 0 && verbose) ? new StepLog(provided >= MPI_THREAD_FUNNELED) : nullptr;
 
-		MPI_Sendrecv(image[1], cols*3, MPI_UNSIGNED_CHAR, dest, tag, 
-			image[rows+1], cols*3, MPI_UNSIGNED_CHAR, src, tag, MPI_COMM_WORLD, &status);
+	//
+	// Okay, now perform contrast stretching, one step at a time, h steps per
+	// ghost exchange:
+	//
+	int step = 1;
+	int lastStep = 0;  // last step a check has looked at
+	int batch = 0, k = 0;
+	bool converged = false;
 
-		//
-		// Okay, for each row in OUR CHUNK, lighten/darken pixel:
-		//
-		for (int row = 1; row <= rows; row++)
+	// The algorithm converges when we have reached the maximum number of steps or
+	// when the images stops changing for every worker
+	while (step <= steps && !converged)
+	{
+		TRACE_SCOPE("step");
+
+		if (k == batch)  // time for a ghost exchange:
 		{
-			//
-			// And for each column (except boundary columns), lighten/darken pixel:
-			//
-			// columns are a little trickier, since a "column" is really 
-			// 3 physical cols: RGB
-			//
-			int basecol = 3;  // start of column (skip boundary column 0):
-
-			for (int col = 1; col < cols - 1; col++, basecol += 3)
-			{
-				diffs += stretch_one_pixel(image2, image, row, basecol);
-			}
+			batch = min(h, steps - step + 1);
+			k = 0;
 		}
 
-		//
-		// copy the boundary rows into the temp image so we can swap
-		// pointers after each step:
-		//
-		copy_boundary(image2, image, rows + 2, cols);
+		k++;
 
-		int root = 0;
+		int r0, r1, c0, c1;
+		Reach(block, batch - k, r0, r1, c0, c1);
 
-		// Master reduces the total differences across all processes
-		MPI_Reduce(&diffs, &totalDiffs, 1, MPI_INT, MPI_SUM, root /* master*/, MPI_COMM_WORLD);
+		// Each process computes the differences for their own block
+		int diffs;
 
-		if (myRank == 0) {
-			cout << "Diff " << totalDiffs << endl;
-			cout.flush();
-		}
+		if (k == 1)
+			diffs = StretchExchanging(image2, image, block, halo[current], r0, r1, c0, c1, hidden, exposed);
+		else
+			diffs = StretchBlock(image2, image, block, r0, r1, c0, c1, nullptr);
 
-		// master has total differences, it has to broadcast it to all processes
-		MPI_Bcast(&totalDiffs, 1, MPI_INT, root /* master*/, MPI_COMM_WORLD);
 		//
 		// flip the image pointers and step:
 		//
@@ -351,47 +608,65 @@ uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
 		image = image2;
 		image2 = tempi;
 
-		step++;
-
-		converged = (totalDiffs == 0);
-
-	}//while-each-step
+		current = 1 - current;
 
+		if (filling->count == 0)
+			filling->first = step;
+		filling->diffs[filling->count++] = diffs;
 
-	//
-	// Okay, we're done, let's make sure the final results are in 
-	// original image matrix so it's returned in the same memory
-	// that was passed to us. We need to do this because the main
-	// process passed in the ENTIRE image, and so it needs that
-	// memory back --- we can't return the temporary image2 matrix
-	// allocated here since it's a different size for main:
-	//
-	if (image != original_image) {
+		step++;
 
-		for (int row = 1; row <= rows; row++)
+		//
+		// Time to check: see how the last check came out, and start this one,
+		// which we'll see about "check" steps from now:
+		//
+		if (filling->count == check || step > steps)
 		{
-			int basecol = 3;  // start of column (skip boundary column 0):
+			converged = FinishCheck(*inFlight, log, lastStep);
 
-			for (int col = 1; col < cols - 1; col++, basecol += 3)
+			if (!converged)
 			{
-				original_image[row][basecol] = image[row][basecol];
-				original_image[row][basecol + 1] = image[row][basecol + 1];
-				original_image[row][basecol + 2] = image[row][basecol + 2];
+				TRACE_BEGIN("reduce");
+				MPI_Iallreduce(filling->diffs, filling->totalDiffs, filling->count, MPI_INT, MPI_SUM,
+					block.grid, &filling->request);
+				TRACE_END("reduce");
+
+				swap(filling, inFlight);
+				filling->count = 0;
 			}
 		}
 
-		Delete2dMatrix(image);
+	}//while-each-step
+
+	// the last check, if still to see:
+	if (!converged)
+		converged = FinishCheck(*inFlight, log, lastStep);
+
+	if (log != nullptr)
+	{
+		log->close();
+		delete log;
 	}
-	else {
-		//
-		// results are already in original memory, so nothing to copy over:
-		//
 
-		Delete2dMatrix(image2);
+	if (myRank == 0 && !verbose)
+		cout << "** Steps: " << lastStep << (converged ? " (converged)" : "") << endl;
+
+	for (int c = 0; c < 2; c++)
+	{
+		delete[] checks[c].diffs;
+		delete[] checks[c].totalDiffs;
 	}
 
+	HaloFree(halo[0]);
+	HaloFree(halo[1]);
+	MPI_Type_free(&column);
+
+	ReportHalo(block, hidden, exposed);
+
 	//
-	// Done! Return updated CHUNK:
+	// Done! Return updated BLOCK, whichever matrix it ended up in:
 	//
-	return original_image;
+	Delete2dMatrix(image2);
+
+	return image;
 }
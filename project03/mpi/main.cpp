@@ -4,7 +4,12 @@
 // Performs a contrast stretch over a Windows bitmap (.bmp) file, making lighter pixels
 // lighter and darker pixels darker.
 //
-// Usage: cs infile.bmp outfile.bmp steps
+// Usage: cs infile.bmp outfile.bmp steps [halo [check]] [-q]
+//
+// where halo is the # of steps done per exchange of ghost rows & columns, which are
+// that many deep (default: picked by timing the exchange and a step), and check is
+// the # of steps per convergence check (default: halo).  With -q, the diff of every
+// step isn't output.
 //
 // Phani Kiran V
 //
@@ -18,8 +23,9 @@
 //
 // Function prototypes:
 //
-uchar** DistributeImage(int myRank, int numProcs, uchar** image, int& rows, int& cols, int& rowsPerProc, int& leftOverRows);
-uchar** CollectImage(int myRank, int numProcs, uchar** image, int rows, int cols, int rowsPerProc, int leftOverRows);
+Block   Decompose(int myRank, int numProcs, int rows, int cols);
+uchar** DistributeImage(const Block& block, uchar** image);
+void    CollectImage(const Block& block, uchar** image, uchar** chunk);
 bool debug_compare_image(
 	char* filename,
 	int steps,
@@ -39,18 +45,37 @@ int main(int argc, char* argv[])
 	char *infile;
 	char *outfile;
 	int   steps, myRank, numProcs;
+	int   halo = 0, check = 0;
+	bool  verbose = true;
+	int   provided;
 
-	MPI_Init(&argc, &argv);
+	// the master outputs steps from a 2nd thread, which makes no MPI calls (if
+	// we get less than FUNNELED, it outputs them itself, see StepLog):
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 	MPI_Comm_size(MPI_COMM_WORLD, &numProcs);  // number of processes involved in run:
 	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);  	 // my proc id: 0 <= myRank < numProcs:
+	TRACE_INIT();  // line up the ranks' trace timelines
 
 	//
 	// process command-line args to program:
 	//
-	if (argc != 4)
+	int* optional[2] = { &halo, &check };
+	int  numbers = 0;  // of the optional ones seen
+
+	for (int i = 4; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-q") == 0)
+			verbose = false;
+		else if (numbers < 2)
+			*optional[numbers++] = atoi(argv[i]);
+		else
+			argc = 0;  // too many args
+	}
+
+	if (argc < 4)
 	{
 		cout << endl;
-		cout << "Usage: mpiexec ... cs infile.bmp outfile.bmp steps" << endl;
+		cout << "Usage: mpiexec ... cs infile.bmp outfile.bmp steps [halo [check]] [-q]" << endl;
 		cout << endl;
 		MPI_Abort(MPI_COMM_WORLD, 0 /*return code*/);
 	}
@@ -84,7 +109,7 @@ int main(int argc, char* argv[])
 	BITMAPFILEHEADER bitmapFileHeader;
 	BITMAPINFOHEADER bitmapInfoHeader;
 	uchar** image = nullptr;
-	int rows = 0, cols = 0, rowsPerProc = 0, leftOverRows = 0;
+	int rows = 0, cols = 0;
 
 	if (myRank == 0)
 	{
@@ -114,19 +139,38 @@ int main(int argc, char* argv[])
     auto start = chrono::high_resolution_clock::now();
 
 	//
-	// MASTER distributes matrix, WORKERS receives their chunk of matrix:
+	// Split the image into a 2D grid of blocks, one per process; MASTER sends each
+	// process their block of the image:
 	//
-	image = DistributeImage(myRank, numProcs, image, rows, cols, rowsPerProc, leftOverRows);
+	TRACE_BEGIN("distribute");
+	Block block = Decompose(myRank, numProcs, rows, cols);
+
+	block.halo = ChooseHalo(block, halo);
+
+	if (check <= 0)
+		check = block.halo;
+
+	if (myRank == 0)
+	{
+		cout << "   Process grid: " << block.dims[0] << " x " << block.dims[1] << endl;
+		cout << "   Halo depth:   " << block.halo << ((halo > 0) ? "" : " (auto)") << endl;
+		cout << "   Check every:  " << check << " steps" << endl;
+	}
+
+	uchar** chunk = DistributeImage(block, image);
+	TRACE_END("distribute");
 
 	//
-	// Okay, everyone performs constrast-stretching on their chunk:
+	// Okay, everyone performs constrast-stretching on their block:
 	//
-	image = ContrastStretch(image, rows, cols, steps);
+	chunk = ContrastStretch(chunk, block, steps, check, verbose);
 
 	//
-	// Collect the results: WORKERS send, MASTER receives and puts image back together:
+	// Collect the results: everyone sends their block, MASTER puts image back together:
 	//
-	image = CollectImage(myRank, numProcs, image, rows, cols, rowsPerProc, leftOverRows);
+	TRACE_BEGIN("collect");
+	CollectImage(block, image, chunk);
+	TRACE_END("collect");
 
     auto stop = chrono::high_resolution_clock::now();
     auto diff = stop - start;
@@ -140,8 +184,7 @@ int main(int argc, char* argv[])
 		cout << endl;
 		cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
 
-		// int originalRows = rowsPerProc * numProcs + leftOverRows;
-		// debug_compare_image("sunset.bmp", steps, false /*verbose off*/, image, 0, originalRows-1, 0, cols-1);
+		// debug_compare_image("sunset.bmp", steps, false /*verbose off*/, image, 0, rows-1, 0, cols-1);
 
 		cout << "** Writing bitmap..." << endl;
 		WriteBitmapFile(outfile, bitmapFileHeader, bitmapInfoHeader, image);
@@ -154,6 +197,9 @@ int main(int argc, char* argv[])
 	//
 	// done:
 	//
+	TRACE_WRITE("trace.json");
+
+	MPI_Comm_free(&block.grid);
 	MPI_Finalize();
 
 	return 0;
@@ -161,118 +207,186 @@ int main(int argc, char* argv[])
 
 
 //
-// DistributeImage: given the original image, rows and cols (from the master process),
-// the master distributes this data to the worker processes.
+// BlockRange: of n rows (or cols) split into "parts" parts as evenly as possible, the
+// first and # of rows of part "index"; the first n % parts parts get 1 extra.
 //
-// Upon return, the master has the entire image, but now rows x cols reflects the
-// CHUNK the master should process.  For the workers, the image matrix contains
-// their CHUNK of the matrix to process (this matrix includes room for ghost rows),
-// along with the size of the matrix chunk (in rows and cols).
+static void BlockRange(int n, int parts, int index, int& first, int& count)
+{
+	count = n / parts + ((index < n % parts) ? 1 : 0);
+	first = index * (n / parts) + min(index, n % parts);
+}
+
+
 //
-// NOTE: any extra rows (due to uneven split across processes) are kept by the master
-// process; these extra rows are viewed as the start of the image.
+// BlockOf: the block of the given process in the grid.
 //
-uchar** DistributeImage(int myRank, int numProcs,
-	                    uchar** image, int& rows, int& cols, 
-						int& rowsPerProc, int& leftOverRows)
+static Block BlockOf(const Block& grid, int rank)
 {
-	int  params[2];
-	int sender = 0;
+	Block block = grid;
 
-	//cout << myRank << " (" << host << "): Distributing image..." << endl;
+	MPI_Cart_coords(grid.grid, rank, 2, block.coords);
 
-	// Master calculates the size of each worker's CHUNK
-	if (myRank == 0) {
-		rowsPerProc = rows / numProcs;
-		leftOverRows = rows % numProcs;
-	}
+	BlockRange(grid.imageRows, grid.dims[0], block.coords[0], block.firstRow, block.rows);
+	BlockRange(grid.imageCols, grid.dims[1], block.coords[1], block.firstCol, block.cols);
 
-	params[0] = rowsPerProc;
-	params[1] = cols;
+	return block;
+}
 
-	// Broadcast the size of each worker's CHUNK
-	MPI_Bcast(params, sizeof(params) / sizeof(params[0]), MPI_INT, sender, MPI_COMM_WORLD);
 
-	//
-	// Workers: receive size of our CHUNK in rows x cols, allocate data for such a 
-	// chunk, and then receive the data itself:
-	//
-	
-	rows = params[0];
-	cols = params[1];
+//
+// BlockType: the datatype of a rows x cols pixel block at [firstRow][firstCol] of a
+// matrixRows x matrixCols pixel matrix, to send / receive it in place.
+//
+static MPI_Datatype BlockType(int matrixRows, int matrixCols, int firstRow, int firstCol, int rows, int cols)
+{
+	int sizes[2] = { matrixRows, matrixCols * 3 };
+	int subsizes[2] = { rows, cols * 3 };
+	int starts[2] = { firstRow, firstCol * 3 };
 
-	//
-	// Master: scatter the image to all the workers (including master)
-	//
+	MPI_Datatype type;
+
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_UNSIGNED_CHAR, &type);
+	MPI_Type_commit(&type);
+
+	return type;
+}
+
+
+//
+// Decompose: given the image size (from the master process), arranges the processes
+// into a 2D grid and returns the block of the image that's ours.
+//
+// Of all the ways to factor numProcs into grid rows x cols, we take the one whose
+// blocks have the shortest perimeter --- the fewest ghost pixels to exchange --- with
+// at least 1 row and column each. So full-width strips for tall images, as before,
+// and more grid columns the wider the image (or the more processes).
+//
+Block Decompose(int myRank, int numProcs, int rows, int cols)
+{
+	int size[2] = { rows, cols };
+
+	MPI_Bcast(size, 2, MPI_INT, 0 /*master*/, MPI_COMM_WORLD);
+
+	Block grid;
+
+	grid.imageRows = size[0];
+	grid.imageCols = size[1];
+	grid.dims[0] = grid.dims[1] = 0;
+	grid.halo = 1;
+
+	double best = 0.0;
+
+	for (int pr = 1; pr <= numProcs; pr++)
+	{
+		int pc = numProcs / pr;
 
-	// Create a new image chunk for the workers
-	if (myRank > 0) {
-		// Allocate memory for the chunk
-		image = New2dMatrix<uchar>(rows + 2, cols * 3);  // worst-case: 2 ghost rows (+2)
+		if (pr * pc != numProcs || pr > grid.imageRows || pc > grid.imageCols)
+			continue;
+
+		double perimeter = (double) grid.imageRows / pr + (double) grid.imageCols / pc;
+
+		if (grid.dims[0] == 0 || perimeter < best)
+		{
+			grid.dims[0] = pr;
+			grid.dims[1] = pc;
+			best = perimeter;
+		}
+	}
+
+	if (grid.dims[0] == 0)
+	{
+		if (myRank == 0)
+			cout << "** Image is too small for " << numProcs << " processes, halting..." << endl;
+		MPI_Abort(MPI_COMM_WORLD, 1 /*return code*/);
 	}
 
-	// master keeps extra rows, scatters the rest (workers recv)
-	uchar* sendbuf = (myRank == 0) ? image[leftOverRows] : nullptr;
+	int periods[2] = { 0, 0 };  // image doesn't wrap around
+
+	MPI_Cart_create(MPI_COMM_WORLD, 2, grid.dims, periods, 0 /*keep ranks*/, &grid.grid);
+
+	return BlockOf(grid, myRank);
+}
+
+
+//
+// DistributeImage: given the original image (in the master process), the master sends
+// each process its block, which is returned: a matrix with the block at [h][h], and
+// room for h ghost rows / columns on each side (h = block.halo).  The master keeps
+// the original image.
+//
+uchar** DistributeImage(const Block& block, uchar** image)
+{
+	int myRank, numProcs;
+
+	MPI_Comm_rank(block.grid, &myRank);
+	MPI_Comm_size(block.grid, &numProcs);
+
+	int h = block.halo;
+
+	uchar** chunk = New2dMatrix<uchar>(block.rows + 2 * h, (block.cols + 2 * h) * 3);
+
+	MPI_Datatype mine = BlockType(block.rows + 2 * h, block.cols + 2 * h, h, h, block.rows, block.cols);
+	MPI_Request request;
+
+	MPI_Irecv(chunk[0], 1, mine, 0 /*master*/, 0, block.grid, &request);
 
 	//
-	// For workers,receive data into newly-allocated matrix, skipping the first row
-	// since it will be used for ghost row storage (which is why it's image[1] below 
-	// and not image[0]). Similarly for master, we receive the data into the 
-	// original image matrix
+	// Master: send every process (including itself) its block, straight out
+	// of the image:
 	//
-	uchar* recvbuf = (myRank == 0) ? (uchar*)MPI_IN_PLACE : image[1];
-	
-
-	MPI_Scatter(sendbuf, rows * cols * 3, MPI_UNSIGNED_CHAR, 
-				recvbuf, rows * cols * 3, MPI_UNSIGNED_CHAR, sender, MPI_COMM_WORLD);
-	
-	
-	// master is now only responsible for their own (the first) chunk:
-	if (myRank == 0) {
-		rows = rowsPerProc + leftOverRows;
+	if (myRank == 0)
+	{
+		for (int p = 0; p < numProcs; p++)
+		{
+			Block theirs = BlockOf(block, p);
+			MPI_Datatype type = BlockType(block.imageRows, block.imageCols,
+				theirs.firstRow, theirs.firstCol, theirs.rows, theirs.cols);
+
+			MPI_Send(image[0], 1, type, p, 0, block.grid);
+			MPI_Type_free(&type);
+		}
 	}
 
-	//
-	// Done!  Everyone returns back a matrix to process... (rows and cols should already
-	// be set for both master and workers)
-	//
-	return image;
+	MPI_Wait(&request, MPI_STATUS_IGNORE);
+	MPI_Type_free(&mine);
+
+	return chunk;
 }
 
 
 //
-// CollectImage: each worker sends in their image chunk (of size rows x cols), and 
-// sends this chunk to the master.  The master collects these chunks and writes them
-// back to the original image matrix.  Note that for all processes, rows and cols 
-// denotes the size of their matrix CHUNK, not the original matrix size.
+// CollectImage: each process sends in their block, and the master puts the blocks
+// back into the original image.  The blocks are freed.
 //
-uchar** CollectImage(int myRank, int numProcs,
-	                 uchar** image, int rows, int cols, 
-	                 int rowsPerProc, int leftOverRows)
+void CollectImage(const Block& block, uchar** image, uchar** chunk)
 {
-	int receiver = 0;
-
-	// if (myRank == 0) {
-	// 	cout << "   Master collecting image..." << endl;
-	// 	cout.flush();
-	// }
-	
-	rowsPerProc = (myRank == 0) ? rowsPerProc : rows;
-		
-	// master receives back the image from all the workers
-	uchar* recvbuf = (myRank == 0) ? image[leftOverRows] : nullptr;
-	uchar* sendbuf = (myRank == 0) ? (uchar*)MPI_IN_PLACE : image[1];
-	
-	MPI_Gather(sendbuf, rowsPerProc * cols * 3, MPI_UNSIGNED_CHAR, 
-				recvbuf, rowsPerProc * cols * 3, MPI_UNSIGNED_CHAR, receiver, MPI_COMM_WORLD);
-
-	if (myRank > 0){
-		Delete2dMatrix<uchar>(image);
-		image = nullptr;
+	int myRank, numProcs;
+
+	MPI_Comm_rank(block.grid, &myRank);
+	MPI_Comm_size(block.grid, &numProcs);
+
+	int h = block.halo;
+
+	MPI_Datatype mine = BlockType(block.rows + 2 * h, block.cols + 2 * h, h, h, block.rows, block.cols);
+	MPI_Request request;
+
+	MPI_Isend(chunk[0], 1, mine, 0 /*master*/, 0, block.grid, &request);
+
+	if (myRank == 0)
+	{
+		for (int p = 0; p < numProcs; p++)
+		{
+			Block theirs = BlockOf(block, p);
+			MPI_Datatype type = BlockType(block.imageRows, block.imageCols,
+				theirs.firstRow, theirs.firstCol, theirs.rows, theirs.cols);
+
+			MPI_Recv(image[0], 1, type, p, 0, block.grid, MPI_STATUS_IGNORE);
+			MPI_Type_free(&type);
+		}
 	}
 
-	// 
-	// Done, return final image:
-	//
-	return image;
+	MPI_Wait(&request, MPI_STATUS_IGNORE);
+	MPI_Type_free(&mine);
+
+	Delete2dMatrix(chunk);
 }
@@ -0,0 +1,99 @@
+/* steplog.h */
+
+//
+// StepLog: the master's per-step console output, written by a background
+// thread, so the step loop never waits on the console (or whatever stdout
+// is redirected to). Text is written in the order it's posted, and all of
+// it by the time close() returns.
+//
+// The thread makes no MPI calls; the main thread still makes them all.
+// Where a 2nd thread isn't allowed (MPI_THREAD_SINGLE), construct it with
+// background = false: there's no thread, and post writes the text itself.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class StepLog {
+	public:
+		StepLog(bool background = true)
+			: Closed(false), Writer(background ? std::thread([this] { write(); }) : std::thread())
+		{
+		}
+
+		~StepLog() { close(); }
+
+		StepLog(const StepLog&) = delete;
+		StepLog& operator=(const StepLog&) = delete;
+
+		//
+		// post: queues text to be written.
+		//
+		void post(std::string text)
+		{
+			if (!Writer.joinable())  // no thread, or closed:
+			{
+				std::cout << text;
+				std::cout.flush();
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Queue.push_back(std::move(text));
+			}
+			Ready.notify_one();
+		}
+
+		//
+		// close: writes whatever is still queued, and stops the thread.
+		//
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Closed = true;
+			}
+			Ready.notify_one();
+
+			if (Writer.joinable())
+				Writer.join();
+		}
+
+	private:
+		std::mutex              Mutex;
+		std::condition_variable Ready;
+		std::deque<std::string> Queue;
+		bool                    Closed;
+		std::thread             Writer;  // last, so it starts after the rest is set up
+
+		void write()
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+
+			for (;;)
+			{
+				Ready.wait(lock, [this] { return Closed || !Queue.empty(); });
+
+				if (Queue.empty())  // closed, and all written:
+					return;
+
+				std::deque<std::string> batch;
+				batch.swap(Queue);
+
+				lock.unlock();
+
+				for (const std::string& text : batch)
+					std::cout << text;
+				std::cout.flush();
+
+				lock.lock();
+			}
+		}
+};
@@ -0,0 +1,107 @@
+/* activeset.h */
+
+//
+// ActiveSet: which parts of the image a contrast-stretch step has to
+// recompute. A pixel's new value depends only on its 3x3 neighborhood, so
+// if nothing in that neighborhood changed in the last step, neither will
+// the pixel: it already holds its new value. Once most of an image has
+// converged, a step then costs time proportional to the region that is
+// still changing, not to the whole image.
+//
+// The image is tracked in tiles, 1 row high and TILE_COLS pixels wide
+// (boundary rows & columns are never computed, so they're in no tile).
+// Tiles are wide enough that calling the row kernel once per tile costs
+// about the same as once per row while the whole image is active. A
+// step computes the active tiles and records which of them changed; the
+// next step's active tiles are the changed ones plus their 8 neighbors.
+// Initially every tile is active.
+//
+// With double buffering, a tile that's skipped must hold the same values
+// in both buffers; it does, since it wasn't active because it didn't change
+// in the step before, i.e. it's the same in the last 2 results.
+//
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#define TILE_COLS 512
+
+struct ActiveSet {
+	int rows, cols;      // of the image, in pixels
+	int tiles;           // per row
+	std::vector<uchar> active, changed;  // rows x tiles
+
+	// first pixel column of tile t, and its # of columns:
+	int first(int t) const { return 1 + t * TILE_COLS; }
+	int width(int t) const { return std::min(TILE_COLS, cols - 1 - first(t)); }
+
+	uchar& isActive(int r, int t)  { return active[r * tiles + t]; }
+	uchar& isChanged(int r, int t) { return changed[r * tiles + t]; }
+};
+
+
+//
+// NewActiveSet: tracking for a ROWSxCOLS image, all of it active.
+//
+inline ActiveSet NewActiveSet(int rows, int cols)
+{
+	ActiveSet set;
+
+	set.rows = rows;
+	set.cols = cols;
+	set.tiles = std::max(0, (cols - 2 + TILE_COLS - 1) / TILE_COLS);
+
+	set.active.assign(rows * set.tiles, 1);
+	set.changed.assign(rows * set.tiles, 0);
+
+	// boundary rows never change:
+	std::fill_n(set.active.begin(), set.tiles, 0);
+	std::fill_n(set.active.end() - set.tiles, set.tiles, 0);
+
+	return set;
+}
+
+
+//
+// NextActive: after a step, makes the tiles that changed and their
+// neighbors the active ones, and clears the changes for the next step.
+// Returns the # of active tiles.
+//
+inline long NextActive(ActiveSet& set)
+{
+	int rows = set.rows, tiles = set.tiles;
+	long count = 0;
+
+	// each tile & its left and right neighbor, per row:
+	std::vector<uchar> across(rows * tiles, 0);
+
+	for (int r = 1; r < rows - 1; r++)
+	{
+		for (int t = 0; t < tiles; t++)
+		{
+			if (!set.isChanged(r, t))
+				continue;
+
+			for (int u = std::max(0, t - 1); u <= std::min(tiles - 1, t + 1); u++)
+				across[r * tiles + u] = 1;
+		}
+	}
+
+	// ... and the rows above and below (not the boundary rows):
+	for (int r = 1; r < rows - 1; r++)
+	{
+		for (int t = 0; t < tiles; t++)
+		{
+			uchar a = across[(r - 1) * tiles + t] | across[r * tiles + t] | across[(r + 1) * tiles + t];
+
+			set.isActive(r, t) = a;
+			count += a;
+		}
+	}
+
+	std::fill(set.changed.begin(), set.changed.end(), 0);
+
+	return count;
+}
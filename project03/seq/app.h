@@ -19,6 +19,8 @@
 #include <cstdint>
 #include <math.h>
 
+#include "trace.h"
+
 #include "matrix.h"
 
 using namespace std;
@@ -67,3 +69,11 @@ void    WriteBitmapFile(char *filename, BITMAPFILEHEADER bitmapFileHeader, BITMA
 
 /* ContrastStretch.cpp */
 uchar **ContrastStretch(uchar **image, int rows, int cols, int steps);
+
+/* kernel.cpp */
+int stretch_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+int stretch_plane_row(uchar* dst, const uchar* above, const uchar* cur, const uchar* below,
+	int width, int stepby);
+void deinterleave_row(const uchar* bgr, int width, uchar* b, uchar* g, uchar* r);
+void interleave_row(uchar* bgr, int width, const uchar* b, const uchar* g, const uchar* r);
@@ -11,212 +11,8 @@
 //
 
 #include "app.h"
-
-
-//
-// Given 9 values (imagine a pixel and its 8 surrounding neighbors), returns the median
-// value while also returning min and max values (via last 2 parameters)
-//
-uchar median(uchar a, uchar b, uchar c, uchar d, uchar e, 
-						 uchar f, uchar g, uchar h, uchar i, uchar &min, uchar &max)
-{
-	uchar A[9];
-
-	A[0] = a;  // capture 9 values:
-	A[1] = b;
-	A[2] = c;
-	A[3] = d;
-	A[4] = e;
-	A[5] = f;
-	A[6] = g;
-	A[7] = h;
-	A[8] = i;
-
-	// selection sort:
-	for(int i=0; i < 8; i++)
-	{
-		int min = i;
-
-		// select smallest in subset:
-		for (int j=i+1; j < 9; j++)
-		{
-			if (A[j] < A[min])
-				min = j;
-		}
-
-		// swap:
-		uchar temp = A[i];
-		A[i] = A[min];
-		A[min] = temp;
-	}//for
-
-	// return min, max & median of 9 elements:
-	min = A[0];
-	max = A[8];
-
-	return A[4];
-}
-
-
-//
-// Given a pixel value (a single RGB value) P and it's 8 neighbors, returns the new
-// pixel value P' based on min & max values of neighbors.
-//
-uchar NewPixelValue(uchar UL, uchar UP, uchar UR,
-										uchar L,  uchar P,  uchar R,
-										uchar DL, uchar DW, uchar DR, 
-	                  int stepby)
-{
-	uchar newp, med, min, max;
-	double ratio;
-
-	med = median(UL, UP, UR, L, P, R, DL, DW, DR, min, max);
-
-	if (min == max)  // pixels are all the same:
-		newp = min;
-	else
-	{
-		// are neighbors darker than pixel, or lighter?
-		ratio = (P - min) / (double) (max - min);
-
-		if (ratio < 0.5)  // darker, so make pixel darker if possible:
-		{
-			if (P > stepby) // beware of underflow:
-				newp = P - stepby;
-			else  
-				newp = 0;
-		}
-		else if (ratio > 0.5)  // lighter, so make pixel lighter if possible:
-		{
-			if (P < 255-stepby)  // beware of overflow:
-				newp = P + stepby;
-			else  
-				newp = 255;
-		}
-		else  // neither, so leave pixel alone:
-			newp = P;
-	}
-
-	// done:
-	return newp;
-}
-
-
-//
-// Copy over boundary rows to 2nd image matrix:
-//
-void copy_boundary(uchar** image2, uchar** image, int rows, int cols)
-{
-	int basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
-	{
-		image2[0][basecol] = image[0][basecol];
-		image2[0][basecol + 1] = image[0][basecol + 1];
-		image2[0][basecol + 2] = image[0][basecol + 2];
-	}
-
-	basecol = 0;
-
-	for (int col = 0; col < cols; col++, basecol += 3)
-	{
-		image2[rows - 1][basecol] = image[rows - 1][basecol];
-		image2[rows - 1][basecol + 1] = image[rows - 1][basecol + 1];
-		image2[rows - 1][basecol + 2] = image[rows - 1][basecol + 2];
-	}
-
-	for (int row = 0; row < rows; row++)
-	{
-		image2[row][0] = image[row][0];
-		image2[row][1] = image[row][1];
-		image2[row][2] = image[row][2];
-	}
-
-	for (int row = 0; row < rows; row++)
-	{
-		image2[row][cols * 3 - 3] = image[row][cols * 3 - 3];
-		image2[row][cols * 3 - 2] = image[row][cols * 3 - 2];
-		image2[row][cols * 3 - 1] = image[row][cols * 3 - 1];
-	}
-
-}
-
-
-//
-// stretch_one_pixel:
-//
-int stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
-{
-	int prevrow = baserow - 1;  // row above
-	int nextrow = baserow + 1;  // row below
-	int changes = 0;
-
-	// columns are a little trickier, since a "column" is really 3 physical cols: RGB
-	int prevcol = basecol - 3;  // previous column start:
-	int nextcol = basecol + 3;  // next column start:
-
-	//
-	// now update each pixel based on nearest neighbors around that pixel:
-	//
-
-	// Blue:
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// did value change?
-	if (image2[baserow][basecol] != image[baserow][basecol])
-	  changes++;
-
-	// Green:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// did value change?
-	if (image2[baserow][basecol] != image[baserow][basecol])
-	  changes++;
-
-	// Red:
-	basecol++;
-	prevcol++;
-	nextcol++;
-
-	image2[baserow][basecol] = NewPixelValue(image[prevrow][prevcol],
-		image[prevrow][basecol],
-		image[prevrow][nextcol],
-		image[baserow][prevcol],
-		image[baserow][basecol],
-		image[baserow][nextcol],
-		image[nextrow][prevcol],
-		image[nextrow][basecol],
-		image[nextrow][nextcol],
-		1 /*stepby*/);
-
-	// did value change?
-	if (image2[baserow][basecol] != image[baserow][basecol])
-	  changes++;
-
-	return changes;
-}
+#include "planar.h"
+#include "activeset.h"
 
 
 //
@@ -230,15 +26,23 @@ int stretch_one_pixel(uchar** image2, uchar** image, int baserow, int basecol)
 uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
 {
 	//
-	// First, we need a temporary 2D matrix of the same size:
+	// First, we work on a planar copy of the image (separate B, G and R planes,
+	// see planar.h), so each channel's neighbors are adjacent in memory. And we
+	// need a temporary one of the same size; both start out as copies of the
+	// image, so the boundary rows & columns are in place and we can swap after
+	// each step:
 	//
-	uchar **image2 = New2dMatrix<uchar>(rows, cols*3);
+	PlanarImage planes = NewPlanarImage(rows, cols);
+	PlanarImage planes2 = NewPlanarImage(rows, cols);
+
+	ToPlanar(planes, image);
+	ToPlanar(planes2, image);
 
 	//
-	// copy the boundary rows into the temp image so we can swap
-	// pointers after each step:
+	// Only the parts of the image near last step's changes can change, so
+	// we keep track of which tiles are still active (see activeset.h):
 	//
-	copy_boundary(image2, image, rows, cols);
+	ActiveSet active = NewActiveSet(rows, cols);
 
 	//
 	// Okay, now perform contrast stretching, one step at a time:
@@ -249,35 +53,42 @@ uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
 
 	while (step <= steps && !converged)
 	{
+		TRACE_SCOPE("step");
+
 		cout << "** Step " << step << "..." << endl;
 
 		//
-		// Okay, for each row (except boundary rows), lighten/darken pixel:
+		// Okay, for each active tile (never the boundary rows & columns),
+		// lighten/darken pixels; a tile is cols [first, first + width) of
+		// a row, so we stretch cols [first - 1, first + width] of the row:
 		//
 		diffs = 0;
 
 		for (int row = 1; row < rows-1; row++)
 		{
-			//
-			// And for each column (except boundary columns), lighten/darken pixel:
-			//
-			// columns are a little trickier, since a "column" is really 
-			// 3 physical cols: RGB
-			//
-			int basecol = 3;  // start of column (skip boundary column 0):
-
-			for (int col = 1; col < cols-1; col++, basecol += 3)
+			for (int t = 0; t < active.tiles; t++)
 			{
-				diffs += stretch_one_pixel(image2, image, row, basecol);
+				if (!active.isActive(row, t))
+					continue;
+
+				int first = active.first(t) - 1;
+				int width = active.width(t) + 2;
+				int tileDiffs = 0;
+
+				for (int c = 0; c < 3; c++)  // Blue, Green, Red:
+					tileDiffs += stretch_plane_row(planes2.row(c, row) + first, planes.row(c, row - 1) + first, planes.row(c, row) + first, planes.row(c, row + 1) + first, width, 1 /*stepby*/);
+
+				active.isChanged(row, t) = (tileDiffs > 0);
+				diffs += tileDiffs;
 			}
 		}
 
+		NextActive(active);
+
 		//
-		// flip the image pointers and step:
+		// flip the images and step:
 		//
-		uchar** tempi = image;
-		image = image2;
-		image2 = tempi;
+		swap(planes, planes2);
 
 		step++;
 
@@ -291,9 +102,12 @@ uchar **ContrastStretch(uchar **image, int rows, int cols, int steps)
 	}//while-each-step
 
 	//
-	// done!
+	// done! back to BGR, in the memory passed to us:
 	//
-	Delete2dMatrix(image2);
+	FromPlanar(image, planes);
+
+	DeletePlanarImage(planes);
+	DeletePlanarImage(planes2);
 
 	return image;
 }
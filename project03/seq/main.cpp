@@ -88,6 +88,8 @@ int main(int argc, char* argv[])
 	cout << endl;
 	cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
 
+	TRACE_WRITE("trace.json");
+
 	cout << "** Writing bitmap..." << endl;
 	WriteBitmapFile(outfile, bitmapFileHeader, bitmapInfoHeader, image);
 
@@ -0,0 +1,88 @@
+/* planar.h */
+
+//
+// PlanarImage: an image stored as 3 separate planes (B, G and R) instead of
+// interleaved BGR pixels, so that within a row each channel is a contiguous,
+// unit-stride run of uchars --- what the vector kernels want.
+//
+// Every plane row starts 64-byte aligned and has PLANAR_PAD uchars of padding
+// on both sides, and every plane has a guard row above row 0 and below the
+// last row, so vector code may read a little past the edges of the image.
+// Padding and guard rows are zero.
+//
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#define PLANAR_ALIGN 64
+#define PLANAR_PAD   64
+
+struct PlanarImage {
+	int    rows, cols;  // in pixels
+	size_t stride;      // uchars from one plane row to the next
+	uchar* data;        // all 3 planes
+	uchar* planes[3];   // row 0, column 0 of B, G and R
+
+	uchar* row(int plane, int r) const { return planes[plane] + r * stride; }
+};
+
+
+//
+// PlanarStride: uchars from one plane row to the next, for images cols pixels wide.
+//
+inline size_t PlanarStride(int cols)
+{
+	return (PLANAR_PAD + cols + PLANAR_PAD + PLANAR_ALIGN - 1) / PLANAR_ALIGN * PLANAR_ALIGN;
+}
+
+
+//
+// NewPlanarImage: allocates a ROWSxCOLS planar image.
+//
+inline PlanarImage NewPlanarImage(int rows, int cols)
+{
+	PlanarImage image;
+
+	image.rows = rows;
+	image.cols = cols;
+	image.stride = PlanarStride(cols);
+
+	size_t planeSize = (rows + 2) * image.stride;  // + guard rows
+
+	image.data = (uchar*) aligned_alloc(PLANAR_ALIGN, 3 * planeSize);
+	memset(image.data, 0, 3 * planeSize);
+
+	for (int c = 0; c < 3; c++)
+		image.planes[c] = image.data + c * planeSize + image.stride + PLANAR_PAD;
+
+	return image;
+}
+
+
+//
+// DeletePlanarImage: returns memory associated with an image returned by NewPlanarImage.
+//
+inline void DeletePlanarImage(PlanarImage& image)
+{
+	free(image.data);
+	image.data = nullptr;
+}
+
+
+//
+// ToPlanar / FromPlanar: copy a BGR image matrix (see matrix.h) of the same
+// size into the planar image, and back.
+//
+inline void ToPlanar(PlanarImage& planar, uchar** image)
+{
+	for (int r = 0; r < planar.rows; r++)
+		deinterleave_row(image[r], planar.cols, planar.row(0, r), planar.row(1, r), planar.row(2, r));
+}
+
+inline void FromPlanar(uchar** image, const PlanarImage& planar)
+{
+	for (int r = 0; r < planar.rows; r++)
+		interleave_row(image[r], planar.cols, planar.row(0, r), planar.row(1, r), planar.row(2, r));
+}